@@ -0,0 +1,9 @@
+#pragma once
+
+namespace opt
+{
+    //Parse values of command line arguments, throw on invalid values
+    bool parse_bool(const char *s);
+    unsigned int parse_uint(const char *s);
+    double parse_double(const char *s);
+}
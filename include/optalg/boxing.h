@@ -1,4 +1,8 @@
 #pragma once
+#include "heuristic_cache.h"
+#include "stats.h"
+#include <cstddef>
+#include <memory>
 #include <vector>
 #include <utility>
 
@@ -14,34 +18,161 @@ namespace opt
             Rectangle(unsigned int width, unsigned int height);
         };
         
+        ///Rectangle placed in a box, refers to the rectangle by index
         struct BoxedRectangle
         {
-            const Rectangle *rectangle;
-            unsigned int x, y;
-            bool transposed;
-            BoxedRectangle(const Rectangle &rectangle, unsigned int x, unsigned int y, bool transposed);
+            static const unsigned int transposed_flag = 0x80000000;
+            unsigned int item;              //Rectangle index, highest bit is set if transposed
+            unsigned short x, y;
+            unsigned short width, height;   //Dimensions as placed
+            BoxedRectangle() = default;
+            BoxedRectangle(unsigned int rectangle, const Rectangle &dimensions, unsigned int x, unsigned int y, bool transposed);
+            unsigned int rectangle() const;
+            bool transposed() const;
             unsigned int x_end() const;
             unsigned int y_end() const;
+            unsigned int area() const;
         };
         
-        struct Box
+        ///Box of rectangles, stored as structure of arrays
+        class Box
         {
-            std::vector<BoxedRectangle> rectangles;
+        protected:
+            //Rows of x, y, width, height, lower and upper halves of item, size() elements each
+            std::vector<unsigned short> _rows;
+
+            //Sums of area and of area times doubled center along x and y, kept for energy
+            unsigned long long _area = 0, _x_moment = 0, _y_moment = 0;
+            void _account(const BoxedRectangle &rectangle, bool add);
+
+        public:
+            size_t size() const;
+            bool empty() const;
+            BoxedRectangle operator[](size_t i) const;
+            void set(size_t i, const BoxedRectangle &rectangle);
+            void push_back(const BoxedRectangle &rectangle);
+            void erase(size_t i);
+            void clear();                   //Keeps capacity of rows
+            void reserve(size_t size);      //Of rows for size rectangles
+            size_t memory_usage() const;
+            unsigned long long area() const;
+            unsigned long long x_moment() const;
+            unsigned long long y_moment() const;
+
+            //Contiguous rows
+            const unsigned short *x() const;
+            const unsigned short *y() const;
+            const unsigned short *width() const;
+            const unsigned short *height() const;
+        };
+
+        ///Boxes shared between copies by reference counting, a shared box is never modified, changes are made to a copy of it
+        class Packing
+        {
+        protected:
+            std::vector<std::shared_ptr<Box>> _boxes;
+            unsigned int _rectangle_number = 0;
+            unsigned long long _hash = 0;
+
+            static unsigned long long _key(size_t box, const BoxedRectangle &rectangle);
+            unsigned long long _box_hash(size_t box, size_t index) const;  //Of rectangles of box as if it was at index
+            Box &_modify(size_t box);
+
+            //Boxes released by packings of the calling thread and owned by none of them are kept and reused with their capacity
+            static std::vector<std::shared_ptr<Box>> &_spare();
+            static std::shared_ptr<Box> _take(const Box &box);
+            static void _release(std::shared_ptr<Box> &&box);
+
+        public:
+            Packing() = default;
+            Packing(const Packing &packing);
+            Packing(Packing &&packing) = default;
+            Packing &operator=(const Packing &packing);
+            Packing &operator=(Packing &&packing) = default;
+            explicit Packing(const std::vector<Box> &boxes);
+            std::vector<Box> boxes() const;
+            size_t size() const;
+            bool empty() const;
+            size_t rectangle_number() const;
+            unsigned long long hash() const;    //Zobrist hash of rectangles at positions in boxes, updated by every change
+            size_t memory_usage() const;        //Including boxes shared with other packings
+            size_t copy_memory_usage() const;   //Of a copy, which shares all boxes
+
+            const Box &box(size_t box) const;
+            size_t size(size_t box) const;
+            BoxedRectangle get(size_t box, size_t i) const;
+            void set(size_t box, size_t i, const BoxedRectangle &rectangle);
+
+            //Moves i-th rectangle of box to the end of new_box (size() opens a new box), removes box if it gets empty
+            void move(size_t box, size_t i, size_t new_box, const BoxedRectangle &rectangle);
         };
 
-        typedef std::vector<bool> BoxImage;
+        ///Order of rectangles by index, with Zobrist hash of rectangles at positions updated by every change
+        class Order
+        {
+        protected:
+            std::vector<unsigned int> _items;
+            unsigned long long _hash = 0;
+
+            static unsigned long long _key(size_t position, unsigned int item);
+
+        public:
+            Order() = default;
+            explicit Order(const std::vector<unsigned int> &items);
+            const std::vector<unsigned int> &items() const;
+            size_t size() const;
+            bool empty() const;
+            unsigned int operator[](size_t i) const;
+            unsigned long long hash() const;
+            size_t memory_usage() const;
+            void swap(size_t i, size_t j);
+
+            //Moves i-th item to position new_i, items between are shifted by one
+            void move(size_t i, size_t new_i);
+        };
+
+        ///Occupancy of a box, row by row, every row is box size bits rounded up to whole words
+        typedef std::vector<unsigned long long> BoxImage;
 
     protected:
+        ///Occupancy kernels, specialized for common box sizes and chosen at construction
+        struct Kernels
+        {
+            void (*fill)(BoxImage *image, unsigned int box_size, const BoxedRectangle &rectangle, bool value);
+            bool (*can_put)(const BoxImage &image, unsigned int box_size, const BoxedRectangle &rectangle);
+            bool (*search)(const BoxImage &image, unsigned int box_size, BoxedRectangle *rectangle);  //First free position by rows
+        };
+
         unsigned int _box_size;
+        const Kernels *_kernels;
         std::vector<Rectangle> _rectangles;
+        std::vector<unsigned int> _shape_classes;   //Class of every rectangle, rectangles of equal dimensions up to rotation share it
+        unsigned int _lower_bound;                  //Of box number of every packing, best of continuous, Martello-Vigo and dual feasible function bounds
+
+        static const Kernels *_select_kernels(unsigned int box_size);
+
+        unsigned int _index(const Rectangle &rectangle) const;
+
+        //Best bound of dual feasible functions applied to widths and heights, paired with the identity, or with each other if pairs
+        unsigned int _function_bound(bool pairs) const;
+
+        //Index of every box of packing in previous packing if both share it, previous.size() otherwise
+        //Boxes are matched in order, so indices of shared boxes are never lower than their new indices
+        static void _shared_boxes(const Packing &previous, const Packing &packing, std::vector<size_t> *indices);
         
         //Image manipulation
         BoxImage _image_create() const;
         void _image_add(BoxImage *image, const BoxedRectangle &rectangle) const;
         void _image_add_all(BoxImage *image, const Box &box) const;
+        void _image_add_all(BoxImage *image, const Packing &packing, size_t box) const;
         void _image_remove(BoxImage *image, const BoxedRectangle &rectangle) const;
         void _image_clear(BoxImage *image) const;
 
+        //Heuristic kernels over rows of a box
+        void _energy(double *energy, const unsigned short *x, const unsigned short *y, const unsigned short *width, const unsigned short *height,
+            size_t size, unsigned int box_i, unsigned int cycle) const;
+        static unsigned int _overlap_area(const unsigned short *x, const unsigned short *y, const unsigned short *width, const unsigned short *height, size_t size);
+
         //Putting rectangles in boxes
         std::pair<bool, BoxedRectangle> _can_transpose_center(const BoxedRectangle &rectangle) const;
         bool _can_put_rectangle(const BoxedRectangle &rectangle) const;
@@ -49,20 +180,187 @@ namespace opt
         std::pair<bool, BoxedRectangle> _can_put_rectangle(const Rectangle &rectangle, const BoxImage &image) const;
         unsigned int _put_rectangle(const Rectangle &rectangle, std::vector<std::pair<Box, BoxImage>> *boxes) const;
 
+        //Boxes from box_number on are unused slots, opening a box resets the next slot in place and allocates only if there is none
+        size_t _open_box(std::vector<std::pair<Box, BoxImage>> *boxes, size_t *box_number) const;
+        unsigned int _put_rectangle(const Rectangle &rectangle, std::vector<std::pair<Box, BoxImage>> *boxes, size_t *box_number) const;
+
     public:
         Boxing(unsigned int box_size, unsigned int item_number, unsigned int item_size_min, unsigned int item_size_max, unsigned int seed);
+        virtual ~Boxing() = default;    //Problems are owned through Boxing pointers
         unsigned int box_size() const;
         unsigned int box_area() const;
+        const std::vector<Rectangle> &rectangles() const;
+        unsigned int lower_bound() const;
 
         //Heuristic helpers
         double energy(const std::vector<Box> &boxes, unsigned int cycle = 1) const;
+        double energy(const Packing &packing, unsigned int cycle = 1) const;
         bool has_overlaps(const std::vector<Box> &boxes) const;
+        bool has_overlaps(const Packing &packing) const;
         unsigned int overlap_area(const BoxedRectangle &a, const BoxedRectangle &b) const;
         unsigned int overlap_area(const std::vector<Box> &boxes) const;
+        unsigned int overlap_area(const Packing &packing) const;
         unsigned int occupied_area(const Box &box) const;
         unsigned int occupied_area(const std::vector<Box> &boxes, double max_occupation = 1.0) const;
         unsigned int least_occupied_area(const std::vector<Box> &boxes) const;
         unsigned int rectangle_number(const std::vector<Box> &boxes, double max_occupation = 1.0) const;
         unsigned int least_rectangle_number(const std::vector<Box> &boxes, double max_occupation = 1.0) const;
     };
+
+    inline unsigned int Boxing::BoxedRectangle::rectangle() const
+    {
+        return item & ~transposed_flag;
+    }
+
+    inline bool Boxing::BoxedRectangle::transposed() const
+    {
+        return (item & transposed_flag) != 0;
+    }
+
+    inline unsigned int Boxing::BoxedRectangle::x_end() const
+    {
+        return x + width;
+    }
+
+    inline unsigned int Boxing::BoxedRectangle::y_end() const
+    {
+        return y + height;
+    }
+
+    inline unsigned int Boxing::BoxedRectangle::area() const
+    {
+        return static_cast<unsigned int>(width) * height;
+    }
+
+    inline size_t Boxing::Box::size() const
+    {
+        return _rows.size() / 6;
+    }
+
+    inline bool Boxing::Box::empty() const
+    {
+        return _rows.empty();
+    }
+
+    inline Boxing::BoxedRectangle Boxing::Box::operator[](size_t i) const
+    {
+        const size_t n = size();
+        BoxedRectangle rectangle;
+        rectangle.x = _rows[i];
+        rectangle.y = _rows[n + i];
+        rectangle.width = _rows[2 * n + i];
+        rectangle.height = _rows[3 * n + i];
+        rectangle.item = _rows[4 * n + i] | (static_cast<unsigned int>(_rows[5 * n + i]) << 16);
+        return rectangle;
+    }
+
+    inline const unsigned short *Boxing::Box::x() const
+    {
+        return _rows.data();
+    }
+
+    inline const unsigned short *Boxing::Box::y() const
+    {
+        return _rows.data() + size();
+    }
+
+    inline const unsigned short *Boxing::Box::width() const
+    {
+        return _rows.data() + 2 * size();
+    }
+
+    inline const unsigned short *Boxing::Box::height() const
+    {
+        return _rows.data() + 3 * size();
+    }
+
+    inline unsigned long long Boxing::Box::area() const
+    {
+        return _area;
+    }
+
+    inline unsigned long long Boxing::Box::x_moment() const
+    {
+        return _x_moment;
+    }
+
+    inline unsigned long long Boxing::Box::y_moment() const
+    {
+        return _y_moment;
+    }
+
+    inline size_t Boxing::Packing::size() const
+    {
+        return _boxes.size();
+    }
+
+    inline bool Boxing::Packing::empty() const
+    {
+        return _boxes.empty();
+    }
+
+    inline size_t Boxing::Packing::rectangle_number() const
+    {
+        return _rectangle_number;
+    }
+
+    inline unsigned long long Boxing::Packing::hash() const
+    {
+        return _hash;
+    }
+
+    inline const Boxing::Box &Boxing::Packing::box(size_t box) const
+    {
+        return *_boxes[box];
+    }
+
+    inline size_t Boxing::Packing::size(size_t box) const
+    {
+        return _boxes[box]->size();
+    }
+
+    inline Boxing::BoxedRectangle Boxing::Packing::get(size_t box, size_t i) const
+    {
+        return (*_boxes[box])[i];
+    }
+
+    inline size_t memory_usage(const Boxing::Box &box)
+    {
+        return box.memory_usage();
+    }
+
+    inline size_t memory_usage(const Boxing::Packing &packing)
+    {
+        return packing.memory_usage();
+    }
+
+    inline const std::vector<unsigned int> &Boxing::Order::items() const
+    {
+        return _items;
+    }
+
+    inline size_t Boxing::Order::size() const
+    {
+        return _items.size();
+    }
+
+    inline bool Boxing::Order::empty() const
+    {
+        return _items.empty();
+    }
+
+    inline unsigned int Boxing::Order::operator[](size_t i) const
+    {
+        return _items[i];
+    }
+
+    inline unsigned long long Boxing::Order::hash() const
+    {
+        return _hash;
+    }
+
+    inline size_t memory_usage(const Boxing::Order &order)
+    {
+        return order.memory_usage();
+    }
 }
\ No newline at end of file
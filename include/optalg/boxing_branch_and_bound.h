@@ -0,0 +1,42 @@
+#pragma once
+#include "boxing.h"
+#include <memory>
+#include <vector>
+
+namespace opt
+{
+    ///Boxing problem on which exact branch and bound can be applied, rectangles are placed one by one at every free normal position
+    class BoxingBranchAndBound : public Boxing
+    {
+    protected:
+        std::vector<unsigned int> _order;                   //Rectangles in order of placement, by decreasing area, equal shapes adjacent
+        std::vector<unsigned long long> _remaining_area;    //Area of rectangles from every position of order to the end
+        std::vector<unsigned int> _remaining_side;          //Shortest side of rectangles from every position of order to the end
+        std::vector<unsigned int> _positions;               //Sums of sides of rectangles, every packing can be pushed left and down to them
+
+        //Free cells of image which can be covered by a square of given side
+        unsigned int _usable_area(const BoxImage &image, unsigned int side) const;
+
+    public:
+        BoxingBranchAndBound(unsigned int box_size, unsigned int item_number, unsigned int item_size_min, unsigned int item_size_max, unsigned int seed);
+
+        //Implementing branch and bound requirements
+        struct Node
+        {
+            std::shared_ptr<const Node> parent;     //Node without the last placement, nodes share their common placements
+            BoxedRectangle placement;               //Last placed rectangle
+            unsigned int box = 0;                   //Box of the last placed rectangle
+            unsigned int depth = 0;                 //Number of placed rectangles
+            unsigned int box_number = 0;
+            unsigned int bound = 0;
+        };
+        Node root() const;
+        void branch(const Node &node, std::vector<Node> *children) const;
+        double bound(const Node &node) const;
+        bool complete(const Node &node) const;
+        double cost(const Node &node) const;
+
+        //Getting specific data
+        std::vector<Box> get_boxes(const Node &node) const;
+    };
+}
@@ -0,0 +1,38 @@
+#pragma once
+#include "boxing.h"
+#include <random>
+#include <vector>
+#include <utility>
+
+namespace opt
+{
+    ///Boxing problem on which ruin and recreate large neighborhood search can be applied, removed rectangles are packed again first fit
+    class BoxingLargeNeighborhood : public Boxing
+    {
+    protected:
+        unsigned int _ruin_boxes, _ruin_nearby;
+        unsigned long long _total_area;
+
+    public:
+        //Ruin empties ruin_boxes boxes chosen with bias towards the least occupied ones, and removes up to ruin_nearby rectangles next to free
+        //space of other boxes, so that removed rectangles may fill that space together with them
+        BoxingLargeNeighborhood(unsigned int box_size, unsigned int item_number, unsigned int item_size_min, unsigned int item_size_max, unsigned int seed,
+            unsigned int ruin_boxes = 2, unsigned int ruin_nearby = 10);
+
+        //Implementing large neighborhood requirements
+        typedef std::vector<std::pair<Box, BoxImage>> Solution;
+        struct Partial
+        {
+            Solution boxes;                     //Boxes left after ruin
+            std::vector<unsigned int> removed;  //Indices of removed rectangles
+        };
+        Solution initial(unsigned int seed) const;
+        Partial ruin(const Solution &solution, std::default_random_engine &engine) const;
+        Solution recreate(const Partial &partial, unsigned int ordering, unsigned int seed) const;
+        double heuristic(const Solution &solution, unsigned int iter) const;
+        bool optimal(const Solution &solution) const;
+
+        //Getting specific data
+        std::vector<Box> get_boxes(const Solution &solution) const;
+    };
+}
@@ -1,5 +1,7 @@
 #pragma once
 #include "boxing.h"
+#include "heuristic_cache.h"
+#include "neighbors.hpp"
 #include <random>
 #include <vector>
 
@@ -10,18 +12,34 @@ namespace opt
     {
     protected:
         unsigned int _window, _hwindow;
+        mutable HeuristicCache _cache;
+        bool _slide;
     
     public:
+        //Slide adds moves of rectangles as far down, left and down-left as they go, and to the lowest free position of the first earlier box
         BoxingNeighborhoodGeometry(unsigned int box_size, unsigned int item_number, unsigned int item_size_min, unsigned int item_size_max, unsigned int seed,
-            unsigned int window, unsigned int hwindow);
+            unsigned int window, unsigned int hwindow, size_t cache_size = HeuristicCache::default_size, bool slide = false);
         
         //Implementing neighborhood requirements
-        typedef std::vector<Box> Solution;
-        typedef std::vector<Solution> SolutionContainer;
+        typedef Packing Solution;
+        struct Context
+        {
+            std::vector<BoxImage> images;   //Images of all boxes of the solution
+            Packing packing;                //Solution of the images, keeps its boxes alive so that unchanged boxes are recognized by address
+        };
+
+    protected:
+        void _slides(const Solution &solution, const Context &context, const BoxImage &image, unsigned int box_i, unsigned int rectangle_i,
+            Neighbors<Solution> *neighborhood) const;
+
+    public:
         Solution initial(unsigned int seed) const;
-        SolutionContainer neighbors(const Solution &solution, std::default_random_engine &engine, unsigned int id = 0, unsigned int nthreads = 1) const;
+        double prepare(const Solution &solution, unsigned int iter, Context *context) const;
+        void neighbors(const Solution &solution, const Context &context, std::default_random_engine &engine, Neighbors<Solution> *neighborhood,
+            unsigned int id = 0, unsigned int nthreads = 1) const;
         double heuristic(const Solution &solution, unsigned int iter) const;
         bool good(const Solution &solution, unsigned int iter) const;
+        bool optimal(const Solution &solution, const Context &context) const;
 
         //Getting specific data
         std::vector<Box> get_boxes(const Solution &solution) const;
@@ -32,18 +50,38 @@ namespace opt
     {
     protected:
         unsigned int _window;
+        mutable HeuristicCache _cache;
+        static unsigned long long _moment(const Rectangle &rectangle);
     
     public:
         BoxingNeighborhoodOrder(unsigned int box_size, unsigned int item_number, unsigned int item_size_min, unsigned int item_size_max, unsigned int seed,
-            unsigned int window);
+            unsigned int window, size_t cache_size = HeuristicCache::default_size);
         
         //Implementing neighborhood requirements
-        typedef std::vector<const Rectangle*> Solution;
-        typedef std::vector<Solution> SolutionContainer;
+        typedef Order Solution;
+        struct Context
+        {
+            std::vector<std::pair<Box, BoxImage>> boxes;    //Packing of the solution, slots after box number are kept for reuse
+            size_t box_number = 0;
+            std::vector<unsigned int> rectangle_affinity;   //Box of every rectangle of the solution
+            std::vector<bool> boxes_empty;                  //Boxes occupied at most by empty threshold
+            std::vector<unsigned int> items;                //Order of the solution
+            std::vector<BoxedRectangle> placements;         //Placement of every rectangle of the solution
+            std::vector<double> prefix_energy;              //Energy of rectangles before every position
+            std::vector<unsigned long long> suffix_moment;  //Area times shorter side of rectangles from every position
+        };
         Solution initial(unsigned int seed) const;
-        SolutionContainer neighbors(const Solution &solution, std::default_random_engine &engine, unsigned int id = 0, unsigned int nthreads = 1) const;
+        double prepare(const Solution &solution, unsigned int iter, Context *context) const;
+        void neighbors(const Solution &solution, const Context &context, std::default_random_engine &engine, Neighbors<Solution> *neighborhood,
+            unsigned int id = 0, unsigned int nthreads = 1) const;
         double heuristic(const Solution &solution, unsigned int iter) const;
+        double heuristic(const Solution &neighbor, const Context &context, unsigned int iter, double threshold) const;
         bool good(const Solution &solution, unsigned int iter) const;
+        bool optimal(const Solution &solution, const Context &context) const;
+
+        //Implementing genetic requirements, children keep a prefix of the first parent and take other rectangles in order of the second one
+        Solution crossover(const Solution &first, const Solution &second, std::default_random_engine &engine) const;
+        void mutate(Solution *solution, std::default_random_engine &engine) const;
 
         //Getting specific data
         std::vector<Box> get_boxes(const Solution &solution) const;
@@ -55,18 +93,28 @@ namespace opt
     protected:
         unsigned int _window, _hwindow;
         unsigned int _desired_iter;
+        unsigned int _focus;
     
     public:
+        //Nonzero focus moves only overlapping rectangles and about focus others chosen randomly every iteration
         BoxingNeighborhoodGeometryOverlap(unsigned int box_size, unsigned int item_number, unsigned int item_size_min, unsigned int item_size_max, unsigned int seed,
-            unsigned int window, unsigned int hwindow, unsigned int desired_iter);
+            unsigned int window, unsigned int hwindow, unsigned int desired_iter, unsigned int focus = 0);
         
         //Implementing neighborhood requirements
-        typedef std::vector<Box> Solution;
-        typedef std::vector<Solution> SolutionContainer;
+        typedef Packing Solution;
+        struct Context
+        {
+            Packing packing;                                        //Solution of the candidates, keeps its boxes alive to recognize unchanged ones
+            std::vector<std::vector<bool>> overlapping;             //Rectangles of every box overlapping another one
+            size_t overlapping_number = 0;
+        };
         Solution initial(unsigned int seed) const;
-        SolutionContainer neighbors(const Solution &solution, std::default_random_engine &engine, unsigned int id = 0, unsigned int nthreads = 1) const;
+        double prepare(const Solution &solution, unsigned int iter, Context *context) const;
+        void neighbors(const Solution &solution, const Context &context, std::default_random_engine &engine, Neighbors<Solution> *neighborhood,
+            unsigned int id = 0, unsigned int nthreads = 1) const;
         double heuristic(const Solution &solution, unsigned int iter) const;
         bool good(const Solution &solution, unsigned int iter) const;
+        bool optimal(const Solution &solution, const Context &context) const;
 
         //Getting specific data
         std::vector<Box> get_boxes(const Solution &solution) const;
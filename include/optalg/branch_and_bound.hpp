@@ -0,0 +1,246 @@
+#pragma once
+#include "stats.h"
+#include "trace.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <condition_variable>
+#include <deque>
+#include <limits>
+#include <mutex>
+#include <vector>
+#include <time.h>
+#ifdef NDEBUG
+    #include <thread>
+#endif
+
+namespace opt
+{
+    /**
+    Solves a minimization problem exactly by depth-first branch and bound
+
+    Problem class should satisfy requirements:
+     - Problem::Node be a partial solution
+
+     - Node Problem::root() returns node from which every solution can be reached
+     - void Problem::branch(Node node, std::vector<Node> *children) pushes children of incomplete node, most promising first, children together
+       must lead to every solution reachable from node (or to an equivalent one)
+     - double Problem::bound(Node node) returns lower bound of cost of every solution reachable from node
+     - bool Problem::complete(Node node) returns if node is a solution
+     - double Problem::cost(Node node) returns cost of complete node
+
+    Every worker explores its own subtrees depth first and steals the shallowest node of another worker when it runs out of them
+    Nodes whose bound is not lower than cost of the best solution found by any worker are pruned
+    Number of worker threads is given by nthreads, zero means hardware concurrency (debug builds always use one thread)
+    Search stops after time_max seconds of wall time, returning the best solution found so far (root if none was found)
+    Bound receives proven lower bound of cost of all solutions, it equals cost of the returned solution if the search was finished
+    Number of expanded nodes is written to nodes if it is not null
+    Steps of every worker (threads 1 to nthreads) are recorded to trace if it is not null
+    Counters of all workers are added to counters of the calling thread if compiled with OPTALG_STATS
+    */
+    template <class Problem> typename Problem::Node branch_and_bound(
+        const Problem &problem,
+        double time_max,
+        double *bound,
+        double *timer,
+        unsigned int nthreads = 0,
+        unsigned long long *nodes = nullptr,
+        Trace *trace = nullptr)
+    {
+        //Define types
+        typedef typename Problem::Node Node;
+        struct Entry
+        {
+            double bound;
+            Node node;
+        };
+        struct Worker
+        {
+            std::mutex mutex;
+            std::deque<Entry> entries;  //Deepest at the back, taken by the owner, shallowest at the front, stolen by others
+            unsigned long long nodes = 0;
+            Stats stats;
+            #ifdef NDEBUG
+                std::thread thread;
+            #endif
+        };
+
+        //Create workers
+        #ifdef NDEBUG
+            if (nthreads == 0) nthreads = std::max(std::thread::hardware_concurrency(), 1u);
+        #else
+            nthreads = 1;
+        #endif
+        std::vector<Worker> workers(nthreads);
+
+        //Start clock, time limit is measured in wall time so that concurrent calls do not use up each other's limit
+        const bool clock_limited = std::isfinite(time_max);
+        const std::chrono::steady_clock::time_point wall_start = std::chrono::steady_clock::now();
+        const clock_t start = clock();
+
+        //Gather counters of this call only
+        #ifdef OPTALG_STATS
+            const Stats outer_stats = thread_stats();
+            thread_stats() = Stats();
+        #endif
+
+        //State shared by workers, incumbent is written under mutex and read without it
+        std::mutex mutex;
+        std::condition_variable wake;
+        std::atomic<double> incumbent(std::numeric_limits<double>::infinity());
+        Node best = problem.root();
+        std::atomic<size_t> queued(1);
+        std::atomic<unsigned int> idle(0);
+        std::atomic<bool> stop(false);
+        bool done = false;
+        workers[0].entries.push_back({ problem.bound(best), best });
+
+        auto work = [&](unsigned int id)
+        {
+            Worker &worker = workers[id];
+            Trace::Span span(trace, "explore", id + 1, Trace::no_iteration);
+            std::vector<Node> children;
+            std::vector<Entry> fresh;
+            unsigned int checks = 0;
+            while (!stop)
+            {
+                //Take own deepest node, or steal shallowest node of another worker
+                Entry entry;
+                bool taken = false;
+                {
+                    std::lock_guard<std::mutex> lock(worker.mutex);
+                    if (!worker.entries.empty())
+                    {
+                        entry = std::move(worker.entries.back());
+                        worker.entries.pop_back();
+                        taken = true;
+                    }
+                }
+                for (unsigned int i = 1; !taken && i < nthreads; i++)
+                {
+                    Worker &victim = workers[(id + i) % nthreads];
+                    std::lock_guard<std::mutex> lock(victim.mutex);
+                    if (!victim.entries.empty())
+                    {
+                        Trace::Span steal_span(trace, "steal", id + 1, Trace::no_iteration);
+                        entry = std::move(victim.entries.front());
+                        victim.entries.pop_front();
+                        taken = true;
+                    }
+                }
+
+                //Wait for nodes, search is finished when all workers wait and no node is left
+                if (!taken)
+                {
+                    std::unique_lock<std::mutex> lock(mutex);
+                    if (++idle == nthreads && queued == 0)
+                    {
+                        done = true;
+                        wake.notify_all();
+                    }
+                    wake.wait(lock, [&]{ return done || queued != 0; });
+                    idle--;
+                    if (done) break;
+                    continue;
+                }
+                queued--;
+
+                //Prune by incumbent found since the node was queued
+                if (entry.bound >= incumbent)
+                {
+                    OPTALG_COUNT(pruned, 1);
+                    continue;
+                }
+
+                //Stop at time limit, the node is kept for the bound
+                if (clock_limited && ++checks % 64 == 0 && std::chrono::duration<double>(std::chrono::steady_clock::now() - wall_start).count() >= time_max)
+                {
+                    {
+                        std::lock_guard<std::mutex> lock(worker.mutex);
+                        worker.entries.push_back(std::move(entry));
+                    }
+                    queued++;
+                    std::lock_guard<std::mutex> lock(mutex);
+                    stop = true;
+                    done = true;
+                    wake.notify_all();
+                    break;
+                }
+
+                //Accept solution
+                worker.nodes++;
+                OPTALG_COUNT(nodes, 1);
+                if (problem.complete(entry.node))
+                {
+                    const double cost = problem.cost(entry.node);
+                    std::lock_guard<std::mutex> lock(mutex);
+                    if (cost < incumbent)
+                    {
+                        best = std::move(entry.node);
+                        incumbent = cost;
+                    }
+                    continue;
+                }
+
+                //Branch, bounds are computed before locking the deque
+                children.clear();
+                problem.branch(entry.node, &children);
+                fresh.clear();
+                for (auto child = children.rbegin(); child != children.rend(); child++)
+                {
+                    const double child_bound = problem.bound(*child);
+                    if (child_bound < incumbent) fresh.push_back({ child_bound, std::move(*child) });
+                    else OPTALG_COUNT(pruned, 1);
+                }
+                if (fresh.empty()) continue;
+                {
+                    std::lock_guard<std::mutex> lock(worker.mutex);
+                    for (auto child = fresh.begin(); child != fresh.end(); child++) worker.entries.push_back(std::move(*child));
+                }
+                queued += fresh.size();
+                if (idle != 0)
+                {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    wake.notify_all();
+                }
+            }
+
+            //Hand counters over to calling thread
+            #ifdef OPTALG_STATS
+                worker.stats = thread_stats();
+                thread_stats() = Stats();
+            #endif
+        };
+
+        //Run workers
+        #ifdef NDEBUG
+            for (unsigned int id = 0; id < nthreads; id++) workers[id].thread = std::thread(work, id);
+            for (unsigned int id = 0; id < nthreads; id++) workers[id].thread.join();
+        #else
+            work(0);
+        #endif
+
+        //Lowest bound of unexplored nodes, solution is optimal if none is left
+        double proven = incumbent;
+        for (auto worker = workers.cbegin(); worker != workers.cend(); worker++)
+        {
+            for (auto entry = worker->entries.cbegin(); entry != worker->entries.cend(); entry++) proven = std::min(proven, entry->bound);
+        }
+        if (bound != nullptr) *bound = proven;
+
+        //Return
+        clock_t finish = clock();
+        if (timer != nullptr) *timer = static_cast<double>(finish - start) / CLOCKS_PER_SEC;
+        if (nodes != nullptr)
+        {
+            *nodes = 0;
+            for (auto worker = workers.cbegin(); worker != workers.cend(); worker++) *nodes += worker->nodes;
+        }
+        #ifdef OPTALG_STATS
+            thread_stats() = outer_stats;
+            for (auto worker = workers.cbegin(); worker != workers.cend(); worker++) thread_stats().merge(worker->stats);
+        #endif
+        return best;
+    }
+}
@@ -0,0 +1,280 @@
+#pragma once
+#include "neighborhood.hpp"
+#include "stats.h"
+#include "trace.h"
+#include "worker_pool.hpp"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cmath>
+#include <functional>
+#include <limits>
+#include <random>
+#include <stdexcept>
+#include <vector>
+#include <time.h>
+#ifdef NDEBUG
+    #include <thread>
+#endif
+
+namespace opt
+{
+    /**
+    Solves an optimization problem by steady-state genetic algorithm
+
+    Problem class should satisfy requirements:
+     - Problem::Solution be a feasible solution
+
+     - Solution Problem::initial(unsigned int seed) returns random feasible solution
+     - Solution Problem::crossover(Solution first, Solution second, std::default_random_engine engine) returns child of two solutions,
+       which should keep a prefix of the first one
+     - void Problem::mutate(Solution *solution, std::default_random_engine engine) changes solution randomly
+     - double Problem::heuristic(Solution solution, unsigned int iter) returns solution heuristics
+
+    Problem class may also share work between a parent and its children, as in neighborhood():
+     - Problem::Context be data derived from a solution
+     - double Problem::prepare(Solution solution, unsigned int iter, Context *context) fills context and returns solution heuristics
+     - double Problem::heuristic(Solution child, Context context, unsigned int iter, double threshold), if defined, evaluates a child with
+       context of its first parent, it may stop at a lower bound not lower than threshold
+     - bool Problem::optimal(Solution solution, Context context), if defined, returns if solution can not be improved, the algorithm stops at it
+
+    Every iteration breeds a batch of half the population from parents chosen by tournaments among population and archive, every child
+    is mutated with probability mutation_rate and replaces the worse of two random members of the population if it is better
+    Archive keeps archive_size best solutions found (at least one), solutions of equal heuristic are kept once
+    Children are bred by the calling thread and evaluated by nthreads worker threads, zero means hardware concurrency (debug builds always use
+    one thread), so results do not depend on the number of threads
+    Algorithm stops after iter_max iterations, after stall_max iterations without improvement of the best solution or after time_max seconds of wall time
+    Best solution after every iteration is appended to log if it is not null
+    Counters of every iteration are appended to stats if compiled with OPTALG_STATS, their sum is added to counters of the calling thread
+    Steps of the calling thread (thread 0) and of every worker (threads 1 to nthreads) are recorded to trace if it is not null
+    Progress, if not empty, is called after every iteration with the best solution, iteration and heuristic, returning false stops the algorithm
+    */
+    template <class Problem> typename Problem::Solution genetic(
+        const Problem &problem,
+        unsigned int population_size,
+        unsigned int archive_size,
+        double mutation_rate,
+        unsigned int iter_max,
+        unsigned int stall_max,
+        double time_max,
+        std::vector<typename Problem::Solution> *log,
+        double *timer,
+        unsigned int nthreads = 0,
+        std::vector<Stats> *stats = nullptr,
+        Trace *trace = nullptr,
+        const std::function<bool(const typename Problem::Solution &solution, unsigned int iter, double heuristic)> &progress = nullptr)
+    {
+        //Define types
+        typedef typename Problem::Solution Solution;
+        typedef ProblemContext<Problem> Context;
+        struct Individual
+        {
+            Solution solution;
+            double heuristic;
+            typename Context::Type context;
+        };
+        struct Child
+        {
+            Individual individual;
+            const Individual *parent;
+            size_t victim;
+            double threshold;
+            bool prepared;
+        };
+        struct Thread
+        {
+            unsigned int id;
+            Stats stats;
+        };
+        if (population_size == 0) throw std::runtime_error("Population is empty");
+        if (!(mutation_rate >= 0 && mutation_rate <= 1)) throw std::runtime_error("Mutation rate is not a probability");
+        archive_size = std::max(archive_size, 1u);
+
+        //Create threads
+        #ifdef NDEBUG
+            if (nthreads == 0) nthreads = std::max(std::thread::hardware_concurrency(), 1u);
+        #else
+            nthreads = 1;
+        #endif
+        std::vector<Thread> threads(nthreads);
+        for (unsigned int id = 0; id < threads.size(); id++) threads[id].id = id;
+
+        //Batch of current iteration, taken by threads one by one
+        unsigned int iter = 0;
+        std::vector<Individual> population(population_size);
+        std::vector<Child> children;
+        std::atomic<size_t> next(0);
+        bool initializing = true;
+        auto work = [&iter, &population, &children, &next, &initializing, &problem, trace](Thread *thread)
+        {
+            Trace::Span span(trace, "evaluate", thread->id + 1, iter);
+            if (initializing)
+            {
+                for (size_t i = next++; i < population.size(); i = next++)
+                {
+                    population[i].solution = problem.initial(static_cast<unsigned int>(i));
+                    population[i].heuristic = Context::prepare(problem, population[i].solution, iter, &population[i].context);
+                    OPTALG_COUNT(heuristics, 1);
+                }
+            }
+            else
+            {
+                //Children which may enter population or archive get their own context
+                for (size_t i = next++; i < children.size(); i = next++)
+                {
+                    Child &child = children[i];
+                    Individual &individual = child.individual;
+                    individual.heuristic = Context::heuristic(problem, individual.solution, child.parent->context, iter, child.threshold);
+                    OPTALG_COUNT(heuristics, 1);
+                    child.prepared = individual.heuristic < child.threshold;
+                    if (child.prepared) Context::prepare(problem, individual.solution, iter, &individual.context);
+                }
+            }
+
+            //Hand counters over to main thread
+            #ifdef OPTALG_STATS
+                thread->stats = thread_stats();
+                thread_stats() = Stats();
+            #endif
+        };
+
+        //Start threads, they wait for batches
+        WorkerPool pool(nthreads, [&work, &threads](unsigned int id) { work(&threads[id]); });
+        auto evaluate = [&]()
+        {
+            next = 0;
+            Trace::Span span(trace, "wait", 0, iter);
+            pool.run();
+        };
+
+        //Start clock, time limit is measured in wall time so that concurrent calls do not use up each other's limit
+        const bool clock_limited = std::isfinite(time_max);
+        const std::chrono::steady_clock::time_point wall_start = std::chrono::steady_clock::now();
+        const clock_t start = clock();
+
+        //Gather counters of this call only
+        #ifdef OPTALG_STATS
+            const Stats outer_stats = thread_stats();
+            Stats total_stats;
+            thread_stats() = Stats();
+        #else
+            (void)stats;
+        #endif
+
+        //Archive is sorted from the best, solutions of equal heuristic are taken for one
+        std::vector<Individual> archive;
+        auto archive_insert = [&archive, archive_size](const Individual &individual)
+        {
+            auto position = std::lower_bound(archive.begin(), archive.end(), individual.heuristic,
+                [](const Individual &member, double heuristic) { return member.heuristic < heuristic; });
+            if (position != archive.end() && position->heuristic == individual.heuristic) return;
+            if (archive.size() == archive_size && position == archive.end()) return;
+            archive.insert(position, individual);
+            if (archive.size() > archive_size) archive.pop_back();
+        };
+
+        //Create population
+        {
+            Trace::Span span(trace, "initial", 0, Trace::no_iteration);
+            evaluate();
+            initializing = false;
+            #ifdef OPTALG_STATS
+                for (unsigned int id = 0; id < threads.size(); id++) total_stats.merge(threads[id].stats);
+            #endif
+            for (auto individual = population.cbegin(); individual != population.cend(); individual++) archive_insert(*individual);
+            if (log != nullptr) log->push_back(archive.front().solution);
+        }
+
+        //Iterate
+        std::default_random_engine engine(0);
+        std::uniform_int_distribution<size_t> parent_distribution(0, population_size - 1);
+        std::bernoulli_distribution mutation_distribution(mutation_rate);
+        const size_t batch_size = std::max<size_t>(population_size / 2, 1);
+        unsigned int stall = 0;
+        for (iter = 1;; iter++)
+        {
+            Trace::Span iteration_span(trace, "iteration", 0, iter);
+
+            //Breed, parents of tournaments are drawn from population and archive
+            {
+                Trace::Span span(trace, "breed", 0, iter);
+                std::uniform_int_distribution<size_t> member_distribution(0, population_size + archive.size() - 1);
+                auto member = [&population, &archive](size_t i) -> const Individual & { return (i < population.size()) ? population[i] : archive[i - population.size()]; };
+                auto tournament = [&]() -> const Individual &
+                {
+                    const Individual &a = member(member_distribution(engine));
+                    const Individual &b = member(member_distribution(engine));
+                    return (a.heuristic <= b.heuristic) ? a : b;
+                };
+                children.resize(batch_size);
+                for (auto child = children.begin(); child != children.end(); child++)
+                {
+                    const Individual &first = tournament();
+                    const Individual &second = tournament();
+                    child->individual.solution = problem.crossover(first.solution, second.solution, engine);
+                    if (mutation_distribution(engine)) problem.mutate(&child->individual.solution, engine);
+                    child->parent = &first;
+                    const size_t a = parent_distribution(engine), b = parent_distribution(engine);
+                    child->victim = (population[a].heuristic >= population[b].heuristic) ? a : b;
+                    child->threshold = std::max(population[child->victim].heuristic,
+                        (archive.size() == archive_size) ? archive.back().heuristic : std::numeric_limits<double>::infinity());
+                    OPTALG_COUNT(copied_bytes, memory_usage(child->individual.solution));
+                }
+            }
+
+            //Evaluate
+            evaluate();
+
+            //Replace, in order of breeding
+            const double best_heuristic = archive.front().heuristic;
+            {
+                Trace::Span span(trace, "replace", 0, iter);
+                for (auto child = children.begin(); child != children.end(); child++)
+                {
+                    if (!child->prepared) continue;
+                    const Individual &individual = child->individual;
+                    archive_insert(individual);
+                    const bool duplicate = std::any_of(population.cbegin(), population.cend(),
+                        [&individual](const Individual &member) { return member.heuristic == individual.heuristic; });
+                    if (!duplicate && individual.heuristic < population[child->victim].heuristic) population[child->victim] = std::move(child->individual);
+                }
+            }
+            const Individual &best = archive.front();
+            if (log != nullptr) log->push_back(best.solution);
+            OPTALG_COUNT(copied_bytes, (log != nullptr) ? memory_usage(best.solution) : 0);
+            stall = (best.heuristic < best_heuristic) ? 0 : stall + 1;
+
+            //Merge counters
+            #ifdef OPTALG_STATS
+                Stats iteration_stats = thread_stats();
+                thread_stats() = Stats();
+                for (unsigned int id = 0; id < threads.size(); id++) iteration_stats.merge(threads[id].stats);
+                total_stats.merge(iteration_stats);
+                if (stats != nullptr) stats->push_back(iteration_stats);
+            #endif
+
+            //Report
+            if (progress)
+            {
+                Trace::Span span(trace, "progress", 0, iter);
+                if (!progress(best.solution, iter, best.heuristic)) break;
+            }
+
+            //Exit
+            if (Context::optimal(problem, best.solution, best.context)) break;     //Best solution can not be improved
+            else if (iter >= iter_max) break;                                       //Maximum iteration reached
+            else if (stall >= stall_max) break;                                     //No improvement for long
+            else if (clock_limited && std::chrono::duration<double>(std::chrono::steady_clock::now() - wall_start).count() >= time_max) break;          //Maximum time reached
+        }
+
+        //Return
+        clock_t finish = clock();
+        if (timer != nullptr) *timer = static_cast<double>(finish - start) / CLOCKS_PER_SEC;
+        #ifdef OPTALG_STATS
+            thread_stats() = outer_stats;
+            thread_stats().merge(total_stats);
+        #endif
+        return archive.front().solution;
+    }
+}
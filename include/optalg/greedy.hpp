@@ -1,5 +1,7 @@
 #pragma once
+#include "trace.h"
 #include <algorithm>
+#include <functional>
 #include <limits>
 #include <set>
 #include <vector>
@@ -19,11 +21,16 @@ namespace opt
      - bool Problem::can_join(Solution solution, Element element) returns if it is possible to add element to solution
      - Solution Problem::join(Solution solution, Element element) adds element to solution
      - double Problem::weight(Element element) returns weight of the element
+
+    Steps are recorded to trace if it is not null
+    Progress, if not empty, is called after every joined element with the solution and number of joined elements, returning false stops the algorithm
     */
     template <class Problem> typename Problem::Solution greedy(
         const Problem &problem,
         std::vector<typename Problem::Solution> *log,
-        double *timer)
+        double *timer,
+        Trace *trace = nullptr,
+        const std::function<bool(const typename Problem::Solution &solution, unsigned int joined)> &progress = nullptr)
     {
         //Start clock
         clock_t start = clock();
@@ -46,26 +53,36 @@ namespace opt
         
         //Weight elements
         std::vector<WeightedElement> weighted_elements;
-        weighted_elements.reserve(elements.size());
-        for (auto element = elements.cbegin(); element != elements.cend(); element++)
         {
-            weighted_elements.push_back(WeightedElement(*element, problem.weight(*element)));
+            Trace::Span span(trace, "weight", 0, Trace::no_iteration);
+            weighted_elements.reserve(elements.size());
+            for (auto element = elements.cbegin(); element != elements.cend(); element++)
+            {
+                weighted_elements.push_back(WeightedElement(*element, problem.weight(*element)));
+            }
         }
         
         //Sort weighted elements by weight
-        std::sort(weighted_elements.begin(), weighted_elements.end());
+        {
+            Trace::Span span(trace, "sort", 0, Trace::no_iteration);
+            std::sort(weighted_elements.begin(), weighted_elements.end());
+        }
         
         //Create empty set
         Solution solution;
         if (log != nullptr) log->push_back(solution);
         
         //Try to add every element
+        unsigned int joined = 0;
         for (auto element = weighted_elements.crbegin(); element != weighted_elements.crend(); element++)
         {
+            Trace::Span span(trace, "join", 0, static_cast<unsigned int>(element - weighted_elements.crbegin()));
             if (problem.can_join(solution, *element->element))
             {
                 solution = problem.join(std::move(solution), *element->element);
+                joined++;
                 if (log != nullptr) log->push_back(solution);
+                if (progress && !progress(solution, joined)) break;
             }
         }
         
@@ -0,0 +1,51 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <memory>
+
+namespace opt
+{
+    ///Returns Zobrist key of a feature, solution hash is the xor of keys of its features
+    inline unsigned long long zobrist_key(unsigned long long feature)
+    {
+        //SplitMix64 finalizer, keys are computed instead of being stored in a table
+        feature += 0x9E3779B97F4A7C15ULL;
+        feature = (feature ^ (feature >> 30)) * 0xBF58476D1CE4E5B9ULL;
+        feature = (feature ^ (feature >> 27)) * 0x94D049BB133111EBULL;
+        return feature ^ (feature >> 31);
+    }
+
+    inline unsigned long long zobrist_key(unsigned long long feature, unsigned long long subfeature)
+    {
+        return zobrist_key(zobrist_key(feature) ^ subfeature);
+    }
+
+    ///Bounded table of heuristic values by solution hash, shared by threads without locks
+    ///Every entry is its own shard: it stores value and hash xored with value, so a torn or overwritten entry is read as a miss
+    class HeuristicCache
+    {
+    protected:
+        struct Entry
+        {
+            std::atomic<unsigned long long> check;
+            std::atomic<unsigned long long> value;
+        };
+
+        std::unique_ptr<Entry[]> _entries;
+        size_t _mask = 0;
+
+    public:
+        static const size_t default_size = 1 << 16;
+
+        HeuristicCache(size_t size = 0);  //Size is rounded down to a power of two, zero disables the cache
+        bool enabled() const;
+        size_t memory_usage() const;
+        bool find(unsigned long long hash, double *value) const;
+        void insert(unsigned long long hash, double value);
+    };
+
+    inline bool HeuristicCache::enabled() const
+    {
+        return _entries != nullptr;
+    }
+}
@@ -0,0 +1,214 @@
+#pragma once
+#include "neighborhood.hpp"
+#include "stats.h"
+#include "trace.h"
+#include "worker_pool.hpp"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cmath>
+#include <functional>
+#include <limits>
+#include <random>
+#include <vector>
+#include <time.h>
+#ifdef NDEBUG
+    #include <thread>
+#endif
+
+namespace opt
+{
+    /**
+    Solves an optimization problem by ruin and recreate large neighborhood search
+
+    Problem class should satisfy requirements:
+     - Problem::Solution be a feasible solution
+     - Problem::Partial be a solution with some elements removed
+
+     - Solution Problem::initial(unsigned int seed) returns initial feasible solution
+     - Partial Problem::ruin(Solution solution, std::default_random_engine engine) removes elements from solution
+     - Solution Problem::recreate(Partial partial, unsigned int ordering, unsigned int seed) inserts removed elements back in given ordering,
+       seed is given for random orderings
+     - double Problem::heuristic(Solution solution, unsigned int iter) returns solution heuristics
+     - bool Problem::optimal(Solution solution), if defined, returns if solution can not be improved, the algorithm stops at it
+
+    Every iteration ruins the current solution once and recreates it in orderings ways on nthreads worker threads, zero means hardware
+    concurrency (debug builds always use one thread). The best recreated solution is accepted if its heuristic is lower than the current one
+    Ruin and seeds are drawn by the calling thread, so results do not depend on the number of threads
+    Algorithm stops after iter_max iterations, after stall_max iterations without improvement or after time_max seconds of wall time
+    Current solution after every iteration is appended to log if it is not null
+    Counters of every iteration are appended to stats if compiled with OPTALG_STATS, their sum is added to counters of the calling thread
+    Steps of the calling thread (thread 0) and of every worker (threads 1 to nthreads) are recorded to trace if it is not null
+    Progress, if not empty, is called after every iteration with the current solution, iteration and heuristic, returning false stops the algorithm
+    */
+    template <class Problem> typename Problem::Solution large_neighborhood(
+        const Problem &problem,
+        unsigned int orderings,
+        unsigned int iter_max,
+        unsigned int stall_max,
+        double time_max,
+        std::vector<typename Problem::Solution> *log,
+        double *timer,
+        unsigned int nthreads = 0,
+        std::vector<Stats> *stats = nullptr,
+        Trace *trace = nullptr,
+        const std::function<bool(const typename Problem::Solution &solution, unsigned int iter, double heuristic)> &progress = nullptr)
+    {
+        //Define types
+        typedef typename Problem::Solution Solution;
+        typedef typename Problem::Partial Partial;
+        typedef ProblemContext<Problem> Context;
+        struct Thread
+        {
+            unsigned int id;
+            Solution solution;
+            double heuristic;
+            unsigned int ordering;
+            Stats stats;
+        };
+        orderings = std::max(orderings, 1u);
+
+        //Create threads
+        #ifdef NDEBUG
+            if (nthreads == 0) nthreads = std::max(std::thread::hardware_concurrency(), 1u);
+        #else
+            nthreads = 1;
+        #endif
+        std::vector<Thread> threads(nthreads);
+        for (unsigned int id = 0; id < threads.size(); id++) threads[id].id = id;
+
+        //Ruined solution of current iteration, orderings are taken by threads one by one
+        unsigned int iter = 0;
+        Partial partial;
+        std::vector<unsigned int> seeds(orderings);
+        std::atomic<unsigned int> next(0);
+        auto work = [&iter, &partial, &seeds, &next, &problem, trace](Thread *thread)
+        {
+            Trace::Span span(trace, "recreate", thread->id + 1, iter);
+            thread->heuristic = std::numeric_limits<double>::infinity();
+            thread->ordering = std::numeric_limits<unsigned int>::max();
+            for (unsigned int ordering = next++; ordering < seeds.size(); ordering = next++)
+            {
+                Solution solution = problem.recreate(partial, ordering, seeds[ordering]);
+                const double heuristic = problem.heuristic(solution, iter);
+                OPTALG_COUNT(heuristics, 1);
+                if (heuristic < thread->heuristic || (heuristic == thread->heuristic && ordering < thread->ordering))
+                {
+                    thread->solution = std::move(solution);
+                    thread->heuristic = heuristic;
+                    thread->ordering = ordering;
+                }
+            }
+
+            //Hand counters over to main thread
+            #ifdef OPTALG_STATS
+                thread->stats = thread_stats();
+                thread_stats() = Stats();
+            #endif
+        };
+
+        //Start threads, they wait for iterations
+        WorkerPool pool(nthreads, [&work, &threads](unsigned int id) { work(&threads[id]); });
+
+        //Start clock, time limit is measured in wall time so that concurrent calls do not use up each other's limit
+        const bool clock_limited = std::isfinite(time_max);
+        const std::chrono::steady_clock::time_point wall_start = std::chrono::steady_clock::now();
+        const clock_t start = clock();
+
+        //Gather counters of this call only
+        #ifdef OPTALG_STATS
+            const Stats outer_stats = thread_stats();
+            Stats total_stats;
+            thread_stats() = Stats();
+        #else
+            (void)stats;
+        #endif
+
+        //Iterate
+        Solution solution;
+        double solution_heuristic;
+        {
+            Trace::Span span(trace, "initial", 0, Trace::no_iteration);
+            solution = problem.initial(0);
+            solution_heuristic = problem.heuristic(solution, 0);
+            OPTALG_COUNT(heuristics, 1);
+            if (log != nullptr) log->push_back(solution);
+            OPTALG_COUNT(copied_bytes, (log != nullptr) ? memory_usage(solution) : 0);
+        }
+        std::default_random_engine engine(0);
+        const typename Context::Type context{};
+        unsigned int stall = 0;
+        for (iter = 1; !Context::optimal(problem, solution, context); iter++)
+        {
+            Trace::Span iteration_span(trace, "iteration", 0, iter);
+
+            //Ruin
+            {
+                Trace::Span span(trace, "ruin", 0, iter);
+                partial = problem.ruin(solution, engine);
+                for (auto seed = seeds.begin(); seed != seeds.end(); seed++) *seed = static_cast<unsigned int>(engine());
+            }
+
+            //Recreate
+            next = 0;
+            {
+                Trace::Span span(trace, "wait", 0, iter);
+                pool.run();
+            }
+
+            //Accept best recreated solution, ties go to the first ordering
+            {
+                Trace::Span span(trace, "accept", 0, iter);
+                Thread *best_thread = nullptr;
+                for (unsigned int id = 0; id < threads.size(); id++)
+                {
+                    if (threads[id].heuristic < solution_heuristic && (best_thread == nullptr || threads[id].heuristic < best_thread->heuristic
+                        || (threads[id].heuristic == best_thread->heuristic && threads[id].ordering < best_thread->ordering)))
+                    {
+                        best_thread = &threads[id];
+                    }
+                }
+                if (best_thread != nullptr)
+                {
+                    std::swap(solution, best_thread->solution);
+                    solution_heuristic = best_thread->heuristic;
+                    stall = 0;
+                }
+                else stall++;
+                if (log != nullptr) log->push_back(solution);
+                OPTALG_COUNT(copied_bytes, (log != nullptr) ? memory_usage(solution) : 0);
+            }
+
+            //Merge counters
+            #ifdef OPTALG_STATS
+                Stats iteration_stats = thread_stats();
+                thread_stats() = Stats();
+                for (unsigned int id = 0; id < threads.size(); id++) iteration_stats.merge(threads[id].stats);
+                total_stats.merge(iteration_stats);
+                if (stats != nullptr) stats->push_back(iteration_stats);
+            #endif
+
+            //Report
+            if (progress)
+            {
+                Trace::Span span(trace, "progress", 0, iter);
+                if (!progress(solution, iter, solution_heuristic)) break;
+            }
+
+            //Exit
+            if (iter >= iter_max) break;                                        //Maximum iteration reached
+            else if (stall >= stall_max) break;                                 //No improvement for long
+            else if (clock_limited && std::chrono::duration<double>(std::chrono::steady_clock::now() - wall_start).count() >= time_max) break;      //Maximum time reached
+        }
+
+        //Return
+        clock_t finish = clock();
+        if (timer != nullptr) *timer = static_cast<double>(finish - start) / CLOCKS_PER_SEC;
+        #ifdef OPTALG_STATS
+            thread_stats() = outer_stats;
+            thread_stats().merge(total_stats);
+        #endif
+        return solution;
+    }
+}
@@ -1,5 +1,13 @@
 #pragma once
+#include "neighbors.hpp"
+#include "stats.h"
+#include "trace.h"
+#include "worker_pool.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
 #include <cmath>
+#include <functional>
 #include <limits>
 #include <random>
 #include <vector>
@@ -10,17 +18,131 @@
 
 namespace opt
 {
+    ///Calls problems with or without per-iteration context in the same way, problems without Problem::Context get an empty one
+    template <class Problem, class = void> struct ProblemContext
+    {
+        typedef typename Problem::Solution Solution;
+        struct Type {};
+
+        static double prepare(const Problem &problem, const Solution &solution, unsigned int iter, Type *)
+        {
+            return problem.heuristic(solution, iter);
+        }
+
+        static void neighbors(const Problem &problem, const Solution &solution, const Type &, std::default_random_engine &engine,
+            Neighbors<Solution> *neighbors, unsigned int id, unsigned int nthreads)
+        {
+            problem.neighbors(solution, engine, neighbors, id, nthreads);
+        }
+
+        static double heuristic(const Problem &problem, const Solution &neighbor, const Type &, unsigned int iter, double)
+        {
+            return problem.heuristic(neighbor, iter);
+        }
+
+        //Optimality check is optional
+        template <class P> static auto optimal(const P &problem, const Solution &solution, const Type &, int) -> decltype(problem.optimal(solution))
+        {
+            return problem.optimal(solution);
+        }
+
+        static bool optimal(const Problem &, const Solution &, const Type &, long)
+        {
+            return false;
+        }
+
+        static bool optimal(const Problem &problem, const Solution &solution, const Type &context)
+        {
+            return optimal(problem, solution, context, 0);
+        }
+    };
+
+    template <class> struct ProblemContextVoid { typedef void type; };
+
+    template <class Problem> struct ProblemContext<Problem, typename ProblemContextVoid<typename Problem::Context>::type>
+    {
+        typedef typename Problem::Solution Solution;
+        typedef typename Problem::Context Type;
+
+        static double prepare(const Problem &problem, const Solution &solution, unsigned int iter, Type *context)
+        {
+            return problem.prepare(solution, iter, context);
+        }
+
+        static void neighbors(const Problem &problem, const Solution &solution, const Type &context, std::default_random_engine &engine,
+            Neighbors<Solution> *neighbors, unsigned int id, unsigned int nthreads)
+        {
+            problem.neighbors(solution, context, engine, neighbors, id, nthreads);
+        }
+
+        //Heuristic with context is optional too
+        template <class P> static auto heuristic(const P &problem, const Solution &neighbor, const Type &context, unsigned int iter, double threshold, int)
+            -> decltype(problem.heuristic(neighbor, context, iter, threshold))
+        {
+            return problem.heuristic(neighbor, context, iter, threshold);
+        }
+
+        static double heuristic(const Problem &problem, const Solution &neighbor, const Type &, unsigned int iter, double, long)
+        {
+            return problem.heuristic(neighbor, iter);
+        }
+
+        static double heuristic(const Problem &problem, const Solution &neighbor, const Type &context, unsigned int iter, double threshold)
+        {
+            return heuristic(problem, neighbor, context, iter, threshold, 0);
+        }
+
+        //Optimality check is optional
+        template <class P> static auto optimal(const P &problem, const Solution &solution, const Type &context, int)
+            -> decltype(problem.optimal(solution, context))
+        {
+            return problem.optimal(solution, context);
+        }
+
+        static bool optimal(const Problem &, const Solution &, const Type &, long)
+        {
+            return false;
+        }
+
+        static bool optimal(const Problem &problem, const Solution &solution, const Type &context)
+        {
+            return optimal(problem, solution, context, 0);
+        }
+    };
+
     /**
     Solves an optimization problem by heuristic neighborhood optimization
     
     Problem class should satisfy requirements:
      - Problem::Solution be a feasible solution
-     - Problem::SolutionContainer be a set of solutions
      
      - Solution Problem::initial() returns initial feasible solution
-     - SolutionContainer Problem::neighbors(Solution solution, int id, int threads) returns solution neighbors
+     - void Problem::neighbors(Solution solution, std::default_random_engine engine, Neighbors<Solution> *neighbors, int id, int threads) pushes solution neighbors
      - double Problem::heuristic(Solution solution, unsigned int iter) returns solution heuristics
      - bool Problem::good(Solution solution, unsigned int iter) returns if solution is good enough and algorithm can terminate
+
+    Problem class may also share read-only work of every iteration between threads:
+     - Problem::Context be data derived from the current solution
+     - double Problem::prepare(Solution solution, unsigned int iter, Context *context) fills context once per iteration and returns solution heuristics
+     - void Problem::neighbors(Solution solution, Context context, std::default_random_engine engine, Neighbors<Solution> *neighbors, int id, int threads)
+       replaces neighbors() without context
+     - double Problem::heuristic(Solution neighbor, Context context, unsigned int iter, double threshold), if defined, replaces heuristic() for
+       neighbors, it may stop at a lower bound of neighbor heuristics not lower than threshold (best heuristic known to the thread), which does not
+       change the chosen neighbor
+
+    Problem class may also recognize solutions which can not be improved, the algorithm stops at them:
+     - bool Problem::optimal(Solution solution), or bool Problem::optimal(Solution solution, Context context) for problems with context,
+       returns if solution is optimal, for example if it meets a lower bound
+
+    Algorithm stops after iter_max iterations or after time_max seconds of wall time
+    Number of worker threads is given by nthreads, zero means hardware concurrency (debug builds always use one thread)
+    Counters of every iteration are appended to stats if compiled with OPTALG_STATS, their sum is added to counters of the calling thread
+    Steps of the calling thread (thread 0) and of every worker (threads 1 to nthreads) are recorded to trace if it is not null
+    Neighbors of all threads occupy approximately memory_max bytes at most, zero means unlimited. Limited neighborhoods are evaluated
+    in chunks, which does not change the chosen neighbor
+    Worker threads and their neighbor buffers live for the whole call, buffers are reused by every iteration instead of being freed
+    Progress, if not empty, is called by the calling thread after every iteration with the current solution, iteration and heuristic,
+    returning false stops the algorithm with the current solution
     */
     template <class Problem> typename Problem::Solution neighborhood(
         Problem &problem,
@@ -28,109 +150,199 @@ namespace opt
         double time_max,
         bool return_good,
         std::vector<typename Problem::Solution> *log,
-        double *timer)
-    {        
+        double *timer,
+        unsigned int nthreads = 0,
+        std::vector<Stats> *stats = nullptr,
+        Trace *trace = nullptr,
+        size_t memory_max = 0,
+        const std::function<bool(const typename Problem::Solution &solution, unsigned int iter, double heuristic)> &progress = nullptr)
+    {
         //Define types
         typedef typename Problem::Solution Solution;
-        typedef typename Problem::SolutionContainer Container;
         struct Thread
         {
             unsigned int id;
             Solution solution;
             double heuristic;
+            Neighbors<Solution> neighbors;
             std::default_random_engine engine;
-            #ifdef NDEBUG
-                std::thread thread;
-            #endif
+            Stats stats;
         };
         
-        //Start threads
+        //Create threads
         #ifdef NDEBUG
-            const unsigned int nthreads = std::thread::hardware_concurrency();
+            if (nthreads == 0) nthreads = std::max(std::thread::hardware_concurrency(), 1u);
         #else
-            const unsigned int nthreads = 1;
+            nthreads = 1;
         #endif
         std::vector<Thread> threads(nthreads);
-        for (unsigned int id = 0; id < threads.size(); id++) threads[id].engine.seed(id);
 
-        //Start clock
+        //State of current iteration, read by threads
+        typedef ProblemContext<Problem> Context;
+        unsigned int iter = 0;
+        double solution_heuristic = 0.0;
+        size_t capacity = 0;
+        Solution solution;
+        typename Context::Type context;
+
+        //Search for best neighbor, chunk by chunk
+        for (unsigned int id = 0; id < threads.size(); id++)
+        {
+            Thread *thread = &threads[id];
+            thread->id = id;
+            thread->engine.seed(id);
+            thread->neighbors = Neighbors<Solution>(0, [&iter, &solution_heuristic, &context, &problem, thread, trace](Solution *chunk, size_t size)
+            {
+                Trace::Span span(trace, "evaluate", thread->id + 1, iter);
+                OPTALG_COUNT(neighbors, size);
+                OPTALG_COUNT(heuristics, size);
+                for (Solution *neighbor = chunk; neighbor != chunk + size; neighbor++)
+                {
+                    double neighbor_heuristic = Context::heuristic(problem, *neighbor, context, iter, std::min(solution_heuristic, thread->heuristic));
+                    if (neighbor_heuristic < solution_heuristic && neighbor_heuristic < thread->heuristic)
+                    {
+                        std::swap(thread->solution, *neighbor);
+                        thread->heuristic = neighbor_heuristic;
+                    }
+                }
+            });
+        }
+        auto work = [&iter, &capacity, &solution, &context, &problem, nthreads, trace](Thread *thread)
+        {
+            //Get neighborhood
+            thread->heuristic = std::numeric_limits<double>::infinity();
+            thread->neighbors.reset(capacity);
+            {
+                Trace::Span span(trace, "neighbors", thread->id + 1, iter);
+                Context::neighbors(problem, solution, context, thread->engine, &thread->neighbors, thread->id, nthreads);
+            }
+            thread->neighbors.flush();
+
+            //Hand counters over to main thread
+            #ifdef OPTALG_STATS
+                thread->stats = thread_stats();
+                thread_stats() = Stats();
+            #endif
+        };
+
+        //Start threads, they wait for iterations
+        WorkerPool pool(nthreads, [&work, &threads](unsigned int id) { work(&threads[id]); });
+
+        //Start clock, time limit is measured in wall time so that concurrent calls do not use up each other's limit
         const bool clock_limited = std::isfinite(time_max);
-        const clock_t clock_max = clock_limited ? static_cast<clock_t>(time_max * CLOCKS_PER_SEC) : 0;
+        const std::chrono::steady_clock::time_point wall_start = std::chrono::steady_clock::now();
         const clock_t start = clock();
         
+        //Gather counters of this call only
+        #ifdef OPTALG_STATS
+            const Stats outer_stats = thread_stats();
+            Stats total_stats;
+            thread_stats() = Stats();
+        #else
+            (void)stats;
+        #endif
+
         //Iterate
-        Solution solution = problem.initial(0);
-        if (log != nullptr) log->push_back(solution);
-        for (unsigned int iter = 0;; iter++)
         {
-            //Get heuristic
-            double solution_heuristic = problem.heuristic(solution, iter);
-                    
-            //Start threads
-            for (unsigned int id = 0; id < threads.size(); id++)
+            Trace::Span span(trace, "initial", 0, Trace::no_iteration);
+            solution = problem.initial(0);
+            if (log != nullptr) log->push_back(solution);
+            OPTALG_COUNT(copied_bytes, (log != nullptr) ? memory_usage(solution) : 0);
+        }
+        for (;; iter++)
+        {
+            Trace::Span iteration_span(trace, "iteration", 0, iter);
+
+            //Get heuristic and context
             {
-                threads[id].id = id;
-                threads[id].heuristic = std::numeric_limits<double>::infinity();
-                #ifdef NDEBUG
-                threads[id].thread = std::thread(
-                [nthreads, iter, solution_heuristic, &solution, &problem](Thread *thread)
-                #else
-                Thread *thread = &threads[0];
-                #endif
-                {
-                    //Get neighborhood
-                    Container neighbors = problem.neighbors(solution, thread->engine, thread->id, nthreads);
+                Trace::Span span(trace, "prepare", 0, iter);
+                solution_heuristic = Context::prepare(problem, solution, iter, &context);
+                OPTALG_COUNT(heuristics, 1);
+            }
 
-                    //Search for best neighbor
-                    for (auto neighbor = neighbors.begin(); neighbor != neighbors.end(); neighbor++)
-                    {
-                        double neighbor_heuristic = problem.heuristic(*neighbor, iter);
-                        if (neighbor_heuristic < solution_heuristic && neighbor_heuristic < thread->heuristic)
-                        {
-                            thread->solution = *neighbor;
-                            thread->heuristic = neighbor_heuristic;
-                        }
-                    }
-                }
-                #ifdef NDEBUG
-                , &threads[id]);
+            //Stop at optimal solution, counters of the check go to the total
+            if (Context::optimal(problem, solution, context))
+            {
+                #ifdef OPTALG_STATS
+                    total_stats.merge(thread_stats());
+                    thread_stats() = Stats();
                 #endif
+                break;
+            }
+
+            //Limit number of neighbors kept by every thread
+            const size_t neighbor_memory = memory_usage(solution);
+            capacity = (memory_max == 0) ? 0 : std::max<size_t>(memory_max / (neighbor_memory * nthreads), 1);
+                    
+            //Run threads
+            {
+                Trace::Span span(trace, "wait", 0, iter);
+                pool.run();
             }
 
             //Search best neighbor
-            Solution best_neighbor;
-            double best_neighbor_heuristic = std::numeric_limits<double>::infinity();
-            for (unsigned int id = 0; id < threads.size(); id++)
+            Thread *best_thread = nullptr;
             {
-                #ifdef NDEBUG
-                    threads[id].thread.join();
-                #endif
-                if (threads[id].heuristic < solution_heuristic && threads[id].heuristic < best_neighbor_heuristic)
+                Trace::Span span(trace, "select", 0, iter);
+                for (unsigned int id = 0; id < threads.size(); id++)
                 {
-                    best_neighbor = threads[id].solution;
-                    best_neighbor_heuristic = threads[id].heuristic;
+                    if (threads[id].heuristic < solution_heuristic && (best_thread == nullptr || threads[id].heuristic < best_thread->heuristic))
+                    {
+                        best_thread = &threads[id];
+                    }
                 }
             }
 
-            //Go to best neighbor
-            if (std::isfinite(best_neighbor_heuristic))
+            //Go to best neighbor, previous solution becomes a buffer of the thread
+            if (best_thread != nullptr)
             {
-                solution = best_neighbor;
+                Trace::Span span(trace, "accept", 0, iter);
+                std::swap(solution, best_thread->solution);
                 if (log != nullptr) log->push_back(solution);
+                OPTALG_COUNT(copied_bytes, (log != nullptr) ? memory_usage(solution) : 0);
+            }
+
+            //Check solution
+            bool exit_allowed = true;
+            if (return_good)
+            {
+                Trace::Span span(trace, "good", 0, iter);
+                exit_allowed = problem.good(solution, iter);
             }
+
+            //Merge counters
+            #ifdef OPTALG_STATS
+                Stats iteration_stats = thread_stats();
+                thread_stats() = Stats();
+                for (unsigned int id = 0; id < threads.size(); id++) iteration_stats.merge(threads[id].stats);
+                for (unsigned int id = 0; id < threads.size(); id++) iteration_stats.neighbor_memory_peak += threads[id].neighbors.peak() * neighbor_memory;
+                total_stats.merge(iteration_stats);
+                if (stats != nullptr) stats->push_back(iteration_stats);
+            #endif
             
+            //Report
+            if (progress)
+            {
+                Trace::Span span(trace, "progress", 0, iter);
+                if (!progress(solution, iter, (best_thread != nullptr) ? best_thread->heuristic : solution_heuristic)) break;
+            }
+
             //Exit
-            if (!return_good || problem.good(solution, iter))                   //If solution is good or allowed to return bad
+            if (exit_allowed)                                                   //If solution is good or allowed to return bad
             {
-                if (!std::isfinite(best_neighbor_heuristic)) break;             //No better neighbor
+                if (best_thread == nullptr) break;                              //No better neighbor
                 else if (iter >= iter_max) break;                               //Maximum iteration reached
-                else if (clock_limited && clock() - start >= clock_max) break;  //Maximum time reached
+                else if (clock_limited && std::chrono::duration<double>(std::chrono::steady_clock::now() - wall_start).count() >= time_max) break;  //Maximum time reached
             }
         }
         
         //Return
         clock_t finish = clock();
         if (timer != nullptr) *timer = static_cast<double>(finish - start) / CLOCKS_PER_SEC;
+        #ifdef OPTALG_STATS
+            thread_stats() = outer_stats;
+            thread_stats().merge(total_stats);
+        #endif
         return solution;
     }
 }
\ No newline at end of file
@@ -0,0 +1,72 @@
+#pragma once
+#include <algorithm>
+#include <cstddef>
+#include <functional>
+#include <vector>
+
+namespace opt
+{
+    /**
+    Container of generated neighbors with bounded size
+
+    Without evaluator all neighbors are kept. With evaluator kept neighbors are handed over to the evaluator in order of generation
+    whenever capacity is reached and when flush() is called, and then discarded.
+    Discarded neighbors are not freed, their storage is reused by next pushes, so a container kept across iterations stops allocating
+    once neighbors of usual size have been pushed. Reset frees those beyond the new capacity, so they do not hold memory of old solutions.
+    */
+    template <class Solution> class Neighbors
+    {
+    public:
+        typedef std::function<void(Solution *neighbors, size_t size)> Evaluator;
+
+    protected:
+        std::vector<Solution> _neighbors;   //Kept neighbors, followed by discarded ones
+        size_t _size;
+        size_t _capacity;
+        size_t _peak;
+        Evaluator _evaluator;
+
+    public:
+        Neighbors() : _size(0), _capacity(0), _peak(0) {}
+
+        Neighbors(size_t capacity, Evaluator evaluator) : _size(0), _capacity(capacity), _peak(0), _evaluator(evaluator) {}
+
+        ///Discards kept neighbors and sets new capacity
+        void reset(size_t capacity)
+        {
+            _size = 0;
+            _capacity = capacity;
+            if (_capacity != 0 && _neighbors.size() > _capacity) _neighbors.erase(_neighbors.begin() + _capacity, _neighbors.end());
+            _peak = _neighbors.size();
+        }
+
+        ///Adds copy of parent solution, returns it for modification
+        Solution &push(const Solution &parent)
+        {
+            if (_capacity != 0 && _size >= _capacity) flush();
+            if (_size < _neighbors.size()) _neighbors[_size] = parent;
+            else _neighbors.push_back(parent);
+            _size++;
+            _peak = std::max(_peak, _neighbors.size());
+            return _neighbors[_size - 1];
+        }
+
+        ///Hands kept neighbors over to evaluator
+        void flush()
+        {
+            if (!_evaluator || _size == 0) return;
+            _evaluator(_neighbors.data(), _size);
+            _size = 0;
+        }
+
+        ///Returns kept neighbors
+        Solution *begin() { return _neighbors.data(); }
+        Solution *end() { return _neighbors.data() + _size; }
+        const Solution *begin() const { return _neighbors.data(); }
+        const Solution *end() const { return _neighbors.data() + _size; }
+        size_t size() const { return _size; }
+
+        ///Returns maximal number of neighbors held at once since last reset, discarded ones included as they keep their memory
+        size_t peak() const { return _peak; }
+    };
+}
\ No newline at end of file
@@ -0,0 +1,75 @@
+#pragma once
+#include <cstddef>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace opt
+{
+    ///Hot path counters, gathered per thread and merged by the algorithms when compiled with OPTALG_STATS
+    struct Stats
+    {
+        unsigned long long neighbors = 0;            //Generated neighbors
+        unsigned long long dropped = 0;              //Neighbors not generated because they are equivalent to the solution or to another neighbor
+        unsigned long long heuristics = 0;           //Heuristic evaluations
+        unsigned long long pruned = 0;               //Heuristic evaluations stopped and branch and bound nodes dropped at a bound which could not be the best
+        unsigned long long nodes = 0;                //Branch and bound nodes expanded
+        unsigned long long probes = 0;               //Feasibility checks of a rectangle against an image
+        unsigned long long probe_cells = 0;          //Image cells scanned by feasibility checks
+        unsigned long long image_cells = 0;          //Image cells written
+        unsigned long long searches = 0;             //Searches of a free position for a rectangle
+        unsigned long long placements = 0;           //Rectangles packed into boxes
+        unsigned long long copied_bytes = 0;         //Bytes of solutions copied
+        unsigned long long neighbor_memory_peak = 0; //Maximal bytes of neighbors kept at once by all threads, merged as maximum
+        unsigned long long allocations = 0;          //Heap allocations, counted by executables replacing operator new
+        unsigned long long cache_lookups = 0;        //Lookups of heuristic values by solution hash
+        unsigned long long cache_hits = 0;           //Lookups which found the value
+
+        void merge(const Stats &other);
+    };
+
+    ///Returns counters of the calling thread
+    inline Stats &thread_stats()
+    {
+        #ifdef __GNUC__
+            static thread_local Stats stats __attribute__((tls_model("initial-exec"))); //Avoids a call per access from the shared library
+        #else
+            static thread_local Stats stats;
+        #endif
+        return stats;
+    }
+
+    #ifdef OPTALG_STATS
+        #define OPTALG_COUNT(counter, value) (::opt::thread_stats().counter += (value))
+    #else
+        #define OPTALG_COUNT(counter, value) ((void)0)
+    #endif
+
+    ///Returns approximate memory occupied by a value, including owned heap memory
+    template <class T> size_t memory_usage(const T &value)
+    {
+        return sizeof(value);
+    }
+
+    template <class T, class U> size_t memory_usage(const std::pair<T, U> &value)
+    {
+        return memory_usage(value.first) + memory_usage(value.second);
+    }
+
+    inline size_t memory_usage(const std::vector<bool> &value)
+    {
+        return sizeof(value) + (value.size() + 7) / 8;
+    }
+
+    template <class T> typename std::enable_if<std::is_trivially_copyable<T>::value, size_t>::type memory_usage(const std::vector<T> &value)
+    {
+        return sizeof(value) + value.size() * sizeof(T);
+    }
+
+    template <class T> typename std::enable_if<!std::is_trivially_copyable<T>::value, size_t>::type memory_usage(const std::vector<T> &value)
+    {
+        size_t usage = sizeof(value);
+        for (auto element = value.cbegin(); element != value.cend(); element++) usage += memory_usage(*element);
+        return usage;
+    }
+}
\ No newline at end of file
@@ -0,0 +1,53 @@
+#pragma once
+#include <chrono>
+#include <mutex>
+#include <ostream>
+#include <vector>
+
+namespace opt
+{
+    ///Timeline of algorithm steps, written in trace event format (chrome://tracing, Perfetto)
+    class Trace
+    {
+    public:
+        ///Measures a step from construction to destruction, does nothing if trace is null
+        class Span
+        {
+        private:
+            Trace *_trace;
+            const char *_name;
+            unsigned int _thread;
+            unsigned int _iteration;
+            std::chrono::steady_clock::time_point _begin;
+
+        public:
+            Span(Trace *trace, const char *name, unsigned int thread, unsigned int iteration);
+            Span(const Span &other) = delete;
+            Span &operator=(const Span &other) = delete;
+            ~Span();
+        };
+
+    protected:
+        struct Event
+        {
+            const char *name;
+            unsigned int thread;
+            unsigned int iteration;
+            double begin, duration;
+        };
+
+        std::chrono::steady_clock::time_point _start;
+        std::vector<Event> _events;
+        unsigned int _thread_number;
+        std::mutex _mutex;
+
+        void _add(const char *name, unsigned int thread, unsigned int iteration,
+            std::chrono::steady_clock::time_point begin, std::chrono::steady_clock::time_point end);
+
+    public:
+        static const unsigned int no_iteration;
+
+        Trace();
+        void write(std::ostream &stream);
+    };
+}
\ No newline at end of file
@@ -0,0 +1,95 @@
+#pragma once
+#include <functional>
+#include <vector>
+#ifdef NDEBUG
+    #include <condition_variable>
+    #include <mutex>
+    #include <thread>
+#endif
+
+namespace opt
+{
+    /**
+    Worker threads which wait for rounds of work, shared by algorithms with per-iteration parallel steps
+
+    Every run() calls work(id) for every id from 0 to size - 1, each on its own thread, and returns when all calls have returned
+    Threads are started by the constructor and joined by the destructor, debug builds make the calls on the calling thread one by one
+    */
+    class WorkerPool
+    {
+    protected:
+        std::function<void(unsigned int id)> _work;
+        unsigned int _size;
+        #ifdef NDEBUG
+            std::vector<std::thread> _threads;
+            std::mutex _mutex;
+            std::condition_variable _start, _finish;
+            unsigned int _generation = 0;
+            unsigned int _running = 0;
+            bool _stop = false;
+
+            void _loop(unsigned int id);
+        #endif
+
+    public:
+        WorkerPool(unsigned int size, const std::function<void(unsigned int id)> &work);
+        WorkerPool(const WorkerPool &) = delete;
+        WorkerPool &operator=(const WorkerPool &) = delete;
+        ~WorkerPool();
+        void run();
+    };
+
+    inline WorkerPool::WorkerPool(unsigned int size, const std::function<void(unsigned int id)> &work) : _work(work), _size(size)
+    {
+        #ifdef NDEBUG
+            for (unsigned int id = 0; id < _size; id++) _threads.push_back(std::thread(&WorkerPool::_loop, this, id));
+        #endif
+    }
+
+    inline WorkerPool::~WorkerPool()
+    {
+        #ifdef NDEBUG
+            {
+                std::lock_guard<std::mutex> lock(_mutex);
+                _stop = true;
+            }
+            _start.notify_all();
+            for (auto thread = _threads.begin(); thread != _threads.end(); thread++) if (thread->joinable()) thread->join();
+        #endif
+    }
+
+    #ifdef NDEBUG
+        inline void WorkerPool::_loop(unsigned int id)
+        {
+            unsigned int generation = 0;
+            while (true)
+            {
+                {
+                    std::unique_lock<std::mutex> lock(_mutex);
+                    _start.wait(lock, [this, generation]{ return _stop || _generation != generation; });
+                    if (_stop) return;
+                    generation = _generation;
+                }
+                _work(id);
+                std::lock_guard<std::mutex> lock(_mutex);
+                if (--_running == 0) _finish.notify_one();
+            }
+        }
+    #endif
+
+    inline void WorkerPool::run()
+    {
+        #ifdef NDEBUG
+            {
+                std::lock_guard<std::mutex> lock(_mutex);
+                _running = _size;
+                _generation++;
+            }
+            _start.notify_all();
+            std::unique_lock<std::mutex> lock(_mutex);
+            _finish.wait(lock, [this]{ return _running == 0; });
+        #else
+            for (unsigned int id = 0; id < _size; id++) _work(id);
+        #endif
+    }
+}
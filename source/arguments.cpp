@@ -0,0 +1,27 @@
+#include "../include/optalg/arguments.h"
+#include <stdexcept>
+#include <stdlib.h>
+#include <string.h>
+
+bool opt::parse_bool(const char *s)
+{
+    if (strcmp(s, "true") == 0) return true;
+    else if (strcmp(s, "false") == 0) return false;
+    else throw std::runtime_error("Invalid boolean value");
+}
+
+unsigned int opt::parse_uint(const char *s)
+{
+    char *end;
+    unsigned int result = strtoul(s, &end, 10);
+    if (*end != '\0') throw std::runtime_error("Invalid integer value");
+    return result;
+}
+
+double opt::parse_double(const char *s)
+{
+    char *end;
+    double result = strtod(s, &end);
+    if (*end != '\0') throw std::runtime_error("Invalid double value");
+    return result;
+}
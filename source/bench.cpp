@@ -0,0 +1,370 @@
+#include "../include/optalg/greedy.hpp"
+#include "../include/optalg/neighborhood.hpp"
+#include "../include/optalg/boxing_greedy.h"
+#include "../include/optalg/boxing_neighborhood.h"
+#include "../include/optalg/arguments.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+#include <map>
+#include <memory>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+#include <string.h>
+#include <time.h>
+
+struct Settings
+{
+    unsigned int repetitions = 5;
+    unsigned int warmup = 1;
+    unsigned int seeds = 3;
+    unsigned int threads = 0;
+    unsigned int iter_max = 20;
+    bool large = false;
+    double tolerance = 0.1;
+    std::string output;
+    std::string compare;
+    std::string current;
+};
+
+///Benchmarked configuration, fixed sizes follow test.sh
+struct Case
+{
+    std::string method;
+    std::string submethod;
+    bool large;
+    unsigned int seed;
+
+    std::string name() const
+    {
+        return method + "/" + submethod + "/" + (large ? "large" : "small") + "/" + std::to_string(seed);
+    }
+};
+
+///One run of a case
+struct Sample
+{
+    double wall, cpu;
+    unsigned int iterations, boxes;
+    double occupation;
+};
+
+///Summary of a series of numbers
+struct Summary
+{
+    double median, p10, p90;
+};
+
+///Summary of a case, as written to and read from JSON
+struct Record
+{
+    std::string name;
+    std::map<std::string, Summary> metrics;
+};
+
+const char *const metric_names[] = { "wall", "cpu", "iterations", "boxes", "occupation" };
+
+Summary summarize(std::vector<double> values)
+{
+    std::sort(values.begin(), values.end());
+    struct Util
+    {
+        static double percentile(const std::vector<double> &sorted, double p)
+        {
+            const double position = p * (sorted.size() - 1);
+            const size_t low = static_cast<size_t>(std::floor(position));
+            const size_t high = static_cast<size_t>(std::ceil(position));
+            return sorted[low] + (position - low) * (sorted[high] - sorted[low]);
+        }
+    };
+    return { Util::percentile(values, 0.5), Util::percentile(values, 0.1), Util::percentile(values, 0.9) };
+}
+
+Sample run(const Case &c, const Settings &settings)
+{
+    const unsigned int box_size = c.large ? 50 : 10;
+    const unsigned int item_number = c.large ? 500 : 100;
+    const unsigned int item_size_min = 1;
+    const unsigned int item_size_max = c.large ? 25 : 5;
+    const unsigned int window = 1, hwindow = 0;
+    const unsigned int desired_iter = c.large ? 500 : 100;
+    const double time_max = std::numeric_limits<double>::infinity();
+    const bool return_good = false;
+
+    const std::chrono::steady_clock::time_point wall_start = std::chrono::steady_clock::now();
+    const clock_t cpu_start = clock();
+    std::unique_ptr<opt::Boxing> boxing;
+    std::vector<opt::Boxing::Box> boxes;
+    unsigned int iterations;
+    double timer;
+    if (c.method == "greedy")
+    {
+        opt::BoxingGreedy::Metric metric;
+        if (c.submethod == "area") metric = opt::BoxingGreedy::Metric::area;
+        else if (c.submethod == "max_size") metric = opt::BoxingGreedy::Metric::max_size;
+        else metric = opt::BoxingGreedy::Metric::min_size;
+        typedef opt::BoxingGreedy Problem;
+        Problem *problem = new Problem(box_size, item_number, item_size_min, item_size_max, c.seed, metric);
+        boxing.reset(problem);
+        std::vector<Problem::Solution> log;
+        boxes = problem->get_boxes(opt::greedy(*problem, &log, &timer));
+        iterations = log.size() - 1;
+    }
+    else if (c.submethod == "geometry")
+    {
+        typedef opt::BoxingNeighborhoodGeometry Problem;
+        Problem *problem = new Problem(box_size, item_number, item_size_min, item_size_max, c.seed, window, hwindow);
+        boxing.reset(problem);
+        std::vector<Problem::Solution> log;
+        boxes = problem->get_boxes(opt::neighborhood(*problem, settings.iter_max, time_max, return_good, &log, &timer, settings.threads));
+        iterations = log.size() - 1;
+    }
+    else if (c.submethod == "order")
+    {
+        typedef opt::BoxingNeighborhoodOrder Problem;
+        Problem *problem = new Problem(box_size, item_number, item_size_min, item_size_max, c.seed, window);
+        boxing.reset(problem);
+        std::vector<Problem::Solution> log;
+        boxes = problem->get_boxes(opt::neighborhood(*problem, settings.iter_max, time_max, return_good, &log, &timer, settings.threads));
+        iterations = log.size() - 1;
+    }
+    else
+    {
+        typedef opt::BoxingNeighborhoodGeometryOverlap Problem;
+        Problem *problem = new Problem(box_size, item_number, item_size_min, item_size_max, c.seed, window, hwindow, desired_iter);
+        boxing.reset(problem);
+        std::vector<Problem::Solution> log;
+        boxes = problem->get_boxes(opt::neighborhood(*problem, settings.iter_max, time_max, return_good, &log, &timer, settings.threads));
+        iterations = log.size() - 1;
+    }
+    const clock_t cpu_finish = clock();
+    const std::chrono::steady_clock::time_point wall_finish = std::chrono::steady_clock::now();
+
+    Sample sample;
+    sample.wall = std::chrono::duration<double>(wall_finish - wall_start).count();
+    sample.cpu = static_cast<double>(cpu_finish - cpu_start) / CLOCKS_PER_SEC;
+    sample.iterations = iterations;
+    sample.boxes = boxes.size();
+    sample.occupation = 100.0 * boxing->occupied_area(boxes) / (boxes.size() * boxing->box_area());
+    return sample;
+}
+
+std::vector<Case> cases(const Settings &settings)
+{
+    const char *const greedy_metrics[] = { "area", "max_size", "min_size" };
+    const char *const neighborhoods[] = { "geometry", "order", "geometry-overlap" };
+    std::vector<Case> result;
+    for (unsigned int large = 0; large < 2; large++)
+    {
+        for (unsigned int seed = 1; seed <= settings.seeds; seed++)
+        {
+            for (unsigned int i = 0; i < 3; i++) result.push_back({ "greedy", greedy_metrics[i], large != 0, seed });
+            if (large != 0 && !settings.large) continue;
+            for (unsigned int i = 0; i < 3; i++) result.push_back({ "neighborhood", neighborhoods[i], large != 0, seed });
+        }
+    }
+    return result;
+}
+
+Record measure(const Case &c, const Settings &settings)
+{
+    for (unsigned int i = 0; i < settings.warmup; i++) run(c, settings);
+
+    std::map<std::string, std::vector<double>> values;
+    for (unsigned int i = 0; i < settings.repetitions; i++)
+    {
+        const Sample sample = run(c, settings);
+        values["wall"].push_back(sample.wall);
+        values["cpu"].push_back(sample.cpu);
+        values["iterations"].push_back(sample.iterations);
+        values["boxes"].push_back(sample.boxes);
+        values["occupation"].push_back(sample.occupation);
+    }
+
+    Record record;
+    record.name = c.name();
+    for (auto value = values.cbegin(); value != values.cend(); value++) record.metrics[value->first] = summarize(value->second);
+    return record;
+}
+
+void write(std::ostream &stream, const Settings &settings, const std::vector<Record> &records)
+{
+    stream << std::setprecision(9);
+    stream << "{" << std::endl;
+    stream << "\"repetitions\": " << settings.repetitions << ", \"warmup\": " << settings.warmup
+        << ", \"threads\": " << settings.threads << ", \"iter_max\": " << settings.iter_max << "," << std::endl;
+    stream << "\"cases\": [" << std::endl;
+    for (auto record = records.cbegin(); record != records.cend(); record++)
+    {
+        stream << "{\"name\": \"" << record->name << "\"";
+        for (unsigned int i = 0; i < sizeof(metric_names) / sizeof(*metric_names); i++)
+        {
+            const Summary &summary = record->metrics.at(metric_names[i]);
+            stream << ", \"" << metric_names[i] << "\": {\"median\": " << summary.median << ", \"p10\": " << summary.p10 << ", \"p90\": " << summary.p90 << "}";
+        }
+        stream << "}" << ((record + 1 != records.cend()) ? "," : "") << std::endl;
+    }
+    stream << "]" << std::endl;
+    stream << "}" << std::endl;
+}
+
+///Reads file written by `write`, one case per line
+std::vector<Record> read(const std::string &path)
+{
+    struct Util
+    {
+        static double number(const std::string &line, size_t position, const char *key)
+        {
+            const std::string pattern = std::string("\"") + key + "\": ";
+            position = line.find(pattern, position);
+            if (position == std::string::npos) throw std::runtime_error("Invalid benchmark file");
+            return opt::parse_double(line.substr(position + pattern.size(), line.find_first_of(",}", position) - position - pattern.size()).c_str());
+        }
+    };
+
+    std::ifstream file(path);
+    if (!file.is_open()) throw std::runtime_error("Cannot open benchmark file");
+    std::vector<Record> records;
+    std::string line;
+    const std::string name_pattern = "{\"name\": \"";
+    while (std::getline(file, line))
+    {
+        if (line.compare(0, name_pattern.size(), name_pattern) != 0) continue;
+        Record record;
+        record.name = line.substr(name_pattern.size(), line.find('"', name_pattern.size()) - name_pattern.size());
+        for (unsigned int i = 0; i < sizeof(metric_names) / sizeof(*metric_names); i++)
+        {
+            const size_t position = line.find(std::string("\"") + metric_names[i] + "\": {");
+            if (position == std::string::npos) throw std::runtime_error("Invalid benchmark file");
+            Summary &summary = record.metrics[metric_names[i]];
+            summary.median = Util::number(line, position, "median");
+            summary.p10 = Util::number(line, position, "p10");
+            summary.p90 = Util::number(line, position, "p90");
+        }
+        records.push_back(record);
+    }
+    return records;
+}
+
+///Compares medians, returns number of regressions
+unsigned int compare(const std::vector<Record> &baseline, const std::vector<Record> &current, double tolerance)
+{
+    unsigned int regressions = 0;
+    std::cout << std::setprecision(5);
+    for (auto record = current.cbegin(); record != current.cend(); record++)
+    {
+        auto base = std::find_if(baseline.cbegin(), baseline.cend(), [&record](const Record &r){ return r.name == record->name; });
+        if (base == baseline.cend())
+        {
+            std::cout << "NEW        " << record->name << std::endl;
+            continue;
+        }
+
+        //Time must not grow more than tolerance, quality must not get worse at all
+        std::vector<std::string> reasons;
+        const char *const times[] = { "wall", "cpu" };
+        for (unsigned int i = 0; i < 2; i++)
+        {
+            const double old_time = base->metrics.at(times[i]).median;
+            const double new_time = record->metrics.at(times[i]).median;
+            if (new_time > old_time * (1 + tolerance))
+                reasons.push_back(std::string(times[i]) + " " + std::to_string(old_time) + "s -> " + std::to_string(new_time) + "s");
+        }
+        const double old_boxes = base->metrics.at("boxes").median;
+        const double new_boxes = record->metrics.at("boxes").median;
+        if (new_boxes > old_boxes) reasons.push_back("boxes " + std::to_string(old_boxes) + " -> " + std::to_string(new_boxes));
+
+        if (reasons.empty()) std::cout << "OK         " << record->name << std::endl;
+        else
+        {
+            std::cout << "REGRESSION " << record->name;
+            for (auto reason = reasons.cbegin(); reason != reasons.cend(); reason++) std::cout << ", " << *reason;
+            std::cout << std::endl;
+            regressions++;
+        }
+    }
+    return regressions;
+}
+
+int _main(int argc, char **argv)
+{
+    Settings settings;
+
+    //Parse
+    for (int i = 1;;)
+    {
+        if (i == argc) break;
+        else if (i == argc - 1) throw std::runtime_error("Argument missing value");
+        const char *argument = argv[i];
+        const char *value = argv[i + 1];
+        if (strcmp(argument, "--repetitions") == 0) settings.repetitions = opt::parse_uint(value);
+        else if (strcmp(argument, "--warmup") == 0) settings.warmup = opt::parse_uint(value);
+        else if (strcmp(argument, "--seeds") == 0) settings.seeds = opt::parse_uint(value);
+        else if (strcmp(argument, "--threads") == 0) settings.threads = opt::parse_uint(value);
+        else if (strcmp(argument, "--iter_max") == 0) settings.iter_max = opt::parse_uint(value);
+        else if (strcmp(argument, "--large") == 0) settings.large = opt::parse_bool(value);
+        else if (strcmp(argument, "--tolerance") == 0) settings.tolerance = opt::parse_double(value);
+        else if (strcmp(argument, "--output") == 0) settings.output = value;
+        else if (strcmp(argument, "--compare") == 0) settings.compare = value;
+        else if (strcmp(argument, "--current") == 0) settings.current = value;
+        else throw std::runtime_error("Invalid argument name");
+        i += 2;
+    }
+    if (settings.repetitions == 0) throw std::runtime_error("Invalid repetition number");
+    if (settings.threads == 0) settings.threads = std::max(std::thread::hardware_concurrency(), 1u);
+
+    //Measure or read existing measurement
+    std::vector<Record> records;
+    if (!settings.current.empty()) records = read(settings.current);
+    else
+    {
+        const std::vector<Case> all_cases = cases(settings);
+        for (auto c = all_cases.cbegin(); c != all_cases.cend(); c++)
+        {
+            std::cerr << c->name() << std::endl;
+            records.push_back(measure(*c, settings));
+        }
+        if (settings.output.empty())
+        {
+            if (settings.compare.empty()) write(std::cout, settings, records);
+        }
+        else
+        {
+            std::ofstream file(settings.output);
+            if (!file.is_open()) throw std::runtime_error("Cannot open output file");
+            write(file, settings, records);
+        }
+    }
+
+    //Compare
+    if (!settings.compare.empty())
+    {
+        const unsigned int regressions = compare(read(settings.compare), records, settings.tolerance);
+        if (regressions > 0)
+        {
+            std::cout << regressions << " regressions" << std::endl;
+            return 2;
+        }
+    }
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    try
+    {
+        return _main(argc, argv);
+    }
+    catch (const std::exception &e)
+    {
+        std::cerr << "Exception: " << e.what() << std::endl;
+    }
+    return 1;
+}
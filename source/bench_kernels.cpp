@@ -0,0 +1,305 @@
+#include "../include/optalg/greedy.hpp"
+#include "../include/optalg/neighborhood.hpp"
+#include "../include/optalg/boxing_greedy.h"
+#include "../include/optalg/boxing_neighborhood.h"
+#include "../include/optalg/arguments.h"
+#include <algorithm>
+#include <chrono>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <string.h>
+
+namespace opt
+{
+    ///Boxing problem with protected primitives exposed for measurement
+    class BoxingKernels : public Boxing
+    {
+    public:
+        using Boxing::Boxing;
+        using Boxing::_image_create;
+        using Boxing::_image_add;
+        using Boxing::_image_add_all;
+        using Boxing::_image_remove;
+        using Boxing::_image_clear;
+        using Boxing::_can_put_rectangle;
+        using Boxing::_put_rectangle;
+    };
+}
+
+struct Settings
+{
+    double min_time = 0.05;
+    unsigned int samples = 7;
+    unsigned int seed = 1;
+    std::string filter;
+};
+
+///Instance and realistic box states of one size class
+struct Instance
+{
+    const char *name;
+    unsigned int box_size, item_number, item_size_min, item_size_max;
+    unsigned int hwindow;
+};
+
+volatile unsigned long long sink;
+
+///Calls kernel in batches until minimal time passes, repeats for every sample, prints median time per operation
+void measure(const Settings &settings, const std::string &name, unsigned int operations_per_call, const std::function<unsigned long long()> &kernel)
+{
+    if (!settings.filter.empty() && name.find(settings.filter) == std::string::npos) return;
+
+    //Calibrate batch size
+    unsigned long long batch = 1;
+    while (true)
+    {
+        const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        for (unsigned long long i = 0; i < batch; i++) sink = sink + kernel();
+        const double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        if (elapsed >= settings.min_time) break;
+        batch = (elapsed < settings.min_time / 100) ? (batch * 100) : static_cast<unsigned long long>(batch * 1.5 * settings.min_time / elapsed) + 1;
+    }
+
+    //Sample
+    std::vector<double> nanoseconds(settings.samples);
+    for (unsigned int sample = 0; sample < settings.samples; sample++)
+    {
+        const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        for (unsigned long long i = 0; i < batch; i++) sink = sink + kernel();
+        const double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        nanoseconds[sample] = 1e9 * elapsed / (batch * operations_per_call);
+    }
+    std::sort(nanoseconds.begin(), nanoseconds.end());
+    const double median = nanoseconds[nanoseconds.size() / 2];
+    const double spread = 100.0 * (nanoseconds.back() - nanoseconds.front()) / median;
+
+    std::cout << std::left << std::setw(48) << name << std::right << std::fixed
+        << std::setw(14) << std::setprecision(1) << median << " ns/op"
+        << std::setw(14) << std::setprecision(0) << 1e9 / median << " op/s"
+        << std::setw(8) << std::setprecision(1) << spread << "%" << std::endl;
+    std::cout.unsetf(std::ios_base::fixed);
+}
+
+///Runs one single-threaded iteration without evaluation: context preparation and neighbor generation
+template <class Problem> unsigned long long count_neighbors(const Problem &problem, const typename Problem::Solution &solution, std::default_random_engine &engine)
+{
+    typedef opt::ProblemContext<Problem> Context;
+    typename Context::Type context;
+    Context::prepare(problem, solution, 0, &context);
+    opt::Neighbors<typename Problem::Solution> neighborhood;
+    Context::neighbors(problem, solution, context, engine, &neighborhood, 0, 1);
+    return neighborhood.size();
+}
+
+void measure_instance(const Settings &settings, const Instance &instance)
+{
+    typedef opt::Boxing::Box Box;
+    typedef opt::Boxing::BoxImage BoxImage;
+    typedef opt::Boxing::BoxedRectangle BoxedRectangle;
+    const std::string prefix = std::string(instance.name) + "/";
+
+    //Dense state: final greedy packing
+    opt::BoxingGreedy greedy(instance.box_size, instance.item_number, instance.item_size_min, instance.item_size_max, settings.seed, opt::BoxingGreedy::Metric::area);
+    const opt::BoxingGreedy::Solution packing = opt::greedy(greedy, nullptr, nullptr);
+    const std::vector<Box> packed_boxes = greedy.get_boxes(packing);
+    const opt::Boxing::Packing packed_solution(packed_boxes);
+    std::vector<BoxImage> packed_images;
+    for (auto box = packing.cbegin(); box != packing.cend(); box++) packed_images.push_back(box->second);
+
+    //Sparse state: initial solution of local search
+    opt::BoxingNeighborhoodGeometry geometry(instance.box_size, instance.item_number, instance.item_size_min, instance.item_size_max, settings.seed, 1, instance.hwindow);
+    const opt::BoxingNeighborhoodGeometry::Solution initial_boxes = geometry.initial(0);
+    opt::BoxingNeighborhoodOrder order(instance.box_size, instance.item_number, instance.item_size_min, instance.item_size_max, settings.seed, 1);
+    const opt::BoxingNeighborhoodOrder::Solution initial_order = order.initial(0);
+    opt::BoxingNeighborhoodGeometryOverlap overlap(instance.box_size, instance.item_number, instance.item_size_min, instance.item_size_max, settings.seed, 1, instance.hwindow, 100);
+    const opt::BoxingNeighborhoodGeometryOverlap::Solution initial_overlap = overlap.initial(0);
+
+    //Kernels use the problem of the states, problems are identical for the same seed
+    const opt::BoxingKernels kernels(instance.box_size, instance.item_number, instance.item_size_min, instance.item_size_max, settings.seed);
+    std::vector<BoxedRectangle> placed;
+    std::vector<unsigned int> placed_box;
+    for (unsigned int box_i = 0; box_i < packed_boxes.size(); box_i++)
+    {
+        for (unsigned int i = 0; i < packed_boxes[box_i].size(); i++)
+        {
+            placed.push_back(packed_boxes[box_i][i]);
+            placed_box.push_back(box_i);
+        }
+    }
+
+    //Feasibility of every placed rectangle against every box (mostly fails early on dense boxes)
+    measure(settings, prefix + "can_put_rectangle/placed", placed.size() * packed_images.size(), [&]()
+    {
+        unsigned long long count = 0;
+        for (auto image = packed_images.cbegin(); image != packed_images.cend(); image++)
+            for (auto rectangle = placed.cbegin(); rectangle != placed.cend(); rectangle++) count += kernels._can_put_rectangle(*rectangle, *image);
+        return count;
+    });
+
+    //Feasibility of every placed rectangle in its own box without itself (succeeds, scans the full area)
+    measure(settings, prefix + "can_put_rectangle/own", placed.size(), [&]()
+    {
+        unsigned long long count = 0;
+        for (unsigned int i = 0; i < placed.size(); i++)
+        {
+            BoxImage &image = packed_images[placed_box[i]];
+            kernels._image_remove(&image, placed[i]);
+            count += kernels._can_put_rectangle(placed[i], image);
+            kernels._image_add(&image, placed[i]);
+        }
+        return count;
+    });
+
+    //First fit position search
+    measure(settings, prefix + "can_put_rectangle/search", kernels.rectangles().size() * packed_images.size(), [&]()
+    {
+        unsigned long long count = 0;
+        for (auto image = packed_images.cbegin(); image != packed_images.cend(); image++)
+            for (auto rectangle = kernels.rectangles().cbegin(); rectangle != kernels.rectangles().cend(); rectangle++)
+                count += kernels._can_put_rectangle(*rectangle, *image).first;
+        return count;
+    });
+
+    //Image updates
+    measure(settings, prefix + "image_add_remove", 2 * placed.size(), [&]()
+    {
+        for (unsigned int i = 0; i < placed.size(); i++)
+        {
+            BoxImage &image = packed_images[placed_box[i]];
+            kernels._image_remove(&image, placed[i]);
+            kernels._image_add(&image, placed[i]);
+        }
+        return static_cast<unsigned long long>(packed_images.front()[0]);
+    });
+
+    measure(settings, prefix + "image_add_all", packed_boxes.size(), [&]()
+    {
+        BoxImage image = kernels._image_create();
+        unsigned long long count = 0;
+        for (auto box = packed_boxes.cbegin(); box != packed_boxes.cend(); box++)
+        {
+            kernels._image_clear(&image);
+            kernels._image_add_all(&image, *box);
+            count += image[0];
+        }
+        return count;
+    });
+
+    //Packing of all rectangles in greedy order
+    measure(settings, prefix + "put_rectangle", placed.size(), [&]()
+    {
+        std::vector<std::pair<Box, BoxImage>> boxes;
+        for (auto rectangle = placed.cbegin(); rectangle != placed.cend(); rectangle++) kernels._put_rectangle(kernels.rectangles()[rectangle->rectangle()], &boxes);
+        return static_cast<unsigned long long>(boxes.size());
+    });
+
+    //Heuristic helpers, per rectangle
+    measure(settings, prefix + "energy/packed", placed.size(), [&]()
+    {
+        return static_cast<unsigned long long>(kernels.energy(packed_solution));
+    });
+    measure(settings, prefix + "energy/cycle", placed.size(), [&]()
+    {
+        return static_cast<unsigned long long>(kernels.energy(packed_solution, 4));
+    });
+    measure(settings, prefix + "overlap_area/packed", placed.size(), [&]()
+    {
+        return static_cast<unsigned long long>(kernels.overlap_area(packed_solution));
+    });
+    measure(settings, prefix + "overlap_area/single_box", initial_overlap.size(0), [&]()
+    {
+        return static_cast<unsigned long long>(kernels.overlap_area(initial_overlap));
+    });
+    measure(settings, prefix + "occupied_area", placed.size(), [&]()
+    {
+        return static_cast<unsigned long long>(kernels.occupied_area(packed_boxes));
+    });
+
+    //Solution copies, per rectangle
+    measure(settings, prefix + "copy/boxes", placed.size(), [&]()
+    {
+        const std::vector<Box> copy = packed_boxes;
+        return static_cast<unsigned long long>(copy.size());
+    });
+    measure(settings, prefix + "copy/packing", placed.size(), [&]()
+    {
+        const opt::Boxing::Packing copy = packed_solution;
+        return static_cast<unsigned long long>(copy.size());
+    });
+    measure(settings, prefix + "copy/packing/modified", placed.size(), [&]()
+    {
+        opt::Boxing::Packing copy = packed_solution;
+        copy.set(0, 0, copy.get(0, 0));
+        return static_cast<unsigned long long>(copy.size());
+    });
+
+    //Neighborhoods, per generated neighbor
+    std::default_random_engine engine(settings.seed);
+    measure(settings, prefix + "neighbors/geometry/initial", count_neighbors(geometry, initial_boxes, engine), [&]()
+    {
+        return count_neighbors(geometry, initial_boxes, engine);
+    });
+    measure(settings, prefix + "neighbors/geometry/packed", count_neighbors(geometry, packed_solution, engine), [&]()
+    {
+        return count_neighbors(geometry, packed_solution, engine);
+    });
+    measure(settings, prefix + "neighbors/order/initial", count_neighbors(order, initial_order, engine), [&]()
+    {
+        return count_neighbors(order, initial_order, engine);
+    });
+    measure(settings, prefix + "neighbors/geometry-overlap/initial", count_neighbors(overlap, initial_overlap, engine), [&]()
+    {
+        return count_neighbors(overlap, initial_overlap, engine);
+    });
+
+    //Every rectangle may move to every box, the neighborhood of a packed large instance does not fit in memory
+    if (packed_boxes.size() * placed.size() < 10000) measure(settings, prefix + "neighbors/geometry-overlap/packed", count_neighbors(overlap, packed_solution, engine), [&]()
+    {
+        return count_neighbors(overlap, packed_solution, engine);
+    });
+}
+
+int _main(int argc, char **argv)
+{
+    Settings settings;
+
+    //Parse
+    for (int i = 1;;)
+    {
+        if (i == argc) break;
+        else if (i == argc - 1) throw std::runtime_error("Argument missing value");
+        const char *argument = argv[i];
+        const char *value = argv[i + 1];
+        if (strcmp(argument, "--min_time") == 0) settings.min_time = opt::parse_double(value);
+        else if (strcmp(argument, "--samples") == 0) settings.samples = opt::parse_uint(value);
+        else if (strcmp(argument, "--seed") == 0) settings.seed = opt::parse_uint(value);
+        else if (strcmp(argument, "--filter") == 0) settings.filter = value;
+        else throw std::runtime_error("Invalid argument name");
+        i += 2;
+    }
+    if (settings.samples == 0) throw std::runtime_error("Invalid sample number");
+
+    //Measure, sizes follow test.sh, neighborhoods of the large instance are limited to nearby boxes to fit in memory
+    const Instance instances[] = { { "small", 10, 100, 1, 5, 0 }, { "large", 50, 500, 1, 25, 2 } };
+    std::cout << std::left << std::setw(48) << "kernel" << std::right << std::setw(20) << "time" << std::setw(19) << "throughput" << std::setw(9) << "spread" << std::endl;
+    for (unsigned int i = 0; i < sizeof(instances) / sizeof(*instances); i++) measure_instance(settings, instances[i]);
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    try
+    {
+        return _main(argc, argv);
+    }
+    catch (const std::exception &e)
+    {
+        std::cerr << "Exception: " << e.what() << std::endl;
+    }
+    return 1;
+}
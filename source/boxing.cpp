@@ -1,70 +1,473 @@
 #include "../include/optalg/boxing.h"
+#include <algorithm>
+#include <limits>
+#include <map>
 #include <random>
+#include <stdexcept>
+
+namespace
+{
+    typedef opt::Boxing::BoxImage BoxImage;
+    typedef opt::Boxing::BoxedRectangle BoxedRectangle;
+
+    unsigned int lowest_bit(unsigned long long word)
+    {
+        #ifdef __GNUC__
+            return __builtin_ctzll(word);
+        #else
+            unsigned int bit = 0;
+            while ((word & 1) == 0) { word >>= 1; bit++; }
+            return bit;
+        #endif
+    }
+
+    ///Kernels of a box size known at compile time, a row is one word
+    template <unsigned int Size> struct FixedGrid
+    {
+        static_assert(Size > 0 && Size <= 64, "Row must fit in a word");
+
+        static unsigned long long row_mask(const BoxedRectangle &rectangle)
+        {
+            return ((rectangle.width >= 64) ? ~0ULL : ((1ULL << rectangle.width) - 1)) << rectangle.x;
+        }
+
+        static void fill(BoxImage *image, unsigned int, const BoxedRectangle &rectangle, bool value)
+        {
+            const unsigned long long mask = row_mask(rectangle);
+            unsigned long long *rows = image->data();
+            for (unsigned int y = rectangle.y; y < rectangle.y_end(); y++) rows[y] = value ? (rows[y] | mask) : (rows[y] & ~mask);
+        }
+
+        static bool can_put(const BoxImage &image, unsigned int, const BoxedRectangle &rectangle)
+        {
+            const unsigned long long mask = row_mask(rectangle);
+            const unsigned long long *rows = image.data();
+            for (unsigned int y = rectangle.y; y < rectangle.y_end(); y++)
+            {
+                if ((rows[y] & mask) != 0)
+                {
+                    OPTALG_COUNT(probe_cells, (y - rectangle.y + 1) * rectangle.width);
+                    return false;
+                }
+            }
+            OPTALG_COUNT(probe_cells, rectangle.area());
+            return true;
+        }
+
+        static bool search(const BoxImage &image, unsigned int, BoxedRectangle *rectangle)
+        {
+            const unsigned int width = rectangle->width;
+            const unsigned int height = rectangle->height;
+            if (width > Size || height > Size) return false;
+            if (width == 0 || height == 0)
+            {
+                rectangle->x = rectangle->y = 0;
+                return true;
+            }
+
+            //Bit x of free is set if width cells from x are free in all rows of the rectangle
+            const unsigned long long positions = (Size - width + 1 >= 64) ? ~0ULL : ((1ULL << (Size - width + 1)) - 1);
+            const unsigned long long *rows = image.data();
+            for (unsigned int y = 0; y + height <= Size; y++)
+            {
+                unsigned long long occupied = 0;
+                for (unsigned int row = y; row < y + height; row++) occupied |= rows[row];
+                unsigned long long free = ~occupied & positions;
+                for (unsigned int shift = 1; shift < width && free != 0; shift++) free &= ~occupied >> shift;
+                if (free != 0)
+                {
+                    rectangle->x = lowest_bit(free);
+                    rectangle->y = y;
+                    return true;
+                }
+            }
+            return false;
+        }
+    };
+
+    ///Kernels of any box size, a row is one or more words
+    struct Grid
+    {
+        static unsigned int row_words(unsigned int box_size)
+        {
+            return (box_size + 63) / 64;
+        }
+
+        static unsigned long long word_mask(const BoxedRectangle &rectangle, unsigned int word)
+        {
+            const unsigned int begin = std::max<unsigned int>(rectangle.x, 64 * word) - 64 * word;
+            const unsigned int end = std::min<unsigned int>(rectangle.x_end() - 64 * word, 64);
+            return ((end >= 64) ? ~0ULL : ((1ULL << end) - 1)) & ~((1ULL << begin) - 1);
+        }
+
+        static void fill(BoxImage *image, unsigned int box_size, const BoxedRectangle &rectangle, bool value)
+        {
+            if (rectangle.width == 0) return;
+            const unsigned int words = row_words(box_size);
+            for (unsigned int word = rectangle.x / 64; word <= (rectangle.x_end() - 1) / 64; word++)
+            {
+                const unsigned long long mask = word_mask(rectangle, word);
+                unsigned long long *cell = image->data() + rectangle.y * words + word;
+                for (unsigned int y = rectangle.y; y < rectangle.y_end(); y++, cell += words) *cell = value ? (*cell | mask) : (*cell & ~mask);
+            }
+        }
+
+        static bool can_put(const BoxImage &image, unsigned int box_size, const BoxedRectangle &rectangle)
+        {
+            if (rectangle.width == 0) return true;
+            const unsigned int words = row_words(box_size);
+            const unsigned int first = rectangle.x / 64, last = (rectangle.x_end() - 1) / 64;
+            for (unsigned int y = rectangle.y; y < rectangle.y_end(); y++)
+            {
+                const unsigned long long *row = image.data() + y * words;
+                for (unsigned int word = first; word <= last; word++)
+                {
+                    if ((row[word] & word_mask(rectangle, word)) != 0)
+                    {
+                        OPTALG_COUNT(probe_cells, (y - rectangle.y + 1) * rectangle.width);
+                        return false;
+                    }
+                }
+            }
+            OPTALG_COUNT(probe_cells, rectangle.area());
+            return true;
+        }
+
+        static bool search(const BoxImage &image, unsigned int box_size, BoxedRectangle *rectangle)
+        {
+            if (rectangle->width > box_size || rectangle->height > box_size) return false;
+            for (unsigned int y = 0; y + rectangle->height <= box_size; y++)
+            {
+                for (unsigned int x = 0; x + rectangle->width <= box_size; x++)
+                {
+                    rectangle->x = x;
+                    rectangle->y = y;
+                    OPTALG_COUNT(probes, 1);
+                    if (can_put(image, box_size, *rectangle)) return true;
+                }
+            }
+            return false;
+        }
+    };
+
+    ///Dual feasible function of Fekete and Schepers scaled to integers, maps box size to scale
+    struct Function
+    {
+        enum class Type
+        {
+            rounding,   //Rounds size down to multiples of box size / (parameter + 1) unless it is one
+            threshold   //Maps sizes above box size - parameter to box size and sizes below parameter to zero
+        };
+        Type type;
+        unsigned int parameter;
+
+        unsigned int operator()(unsigned int size, unsigned int box_size) const
+        {
+            if (type == Type::rounding)
+            {
+                const unsigned int scaled = (parameter + 1) * size;
+                return (scaled % box_size == 0) ? scaled : scaled / box_size * box_size;
+            }
+            else if (size > box_size - parameter) return box_size;
+            else if (size < parameter) return 0;
+            else return size;
+        }
+
+        unsigned int scale(unsigned int box_size) const
+        {
+            return (type == Type::rounding) ? (parameter + 1) * box_size : box_size;
+        }
+    };
+}
 
 opt::Boxing::Rectangle::Rectangle(unsigned int width, unsigned int height)
     : width(width), height(height) {}
 
-opt::Boxing::BoxedRectangle::BoxedRectangle(const Rectangle &rectangle, unsigned int x, unsigned int y, bool transposed)
-    : rectangle(&rectangle), x(x), y(y), transposed(transposed) {}
+opt::Boxing::BoxedRectangle::BoxedRectangle(unsigned int rectangle, const Rectangle &dimensions, unsigned int x, unsigned int y, bool transposed)
+    : item(rectangle | (transposed ? transposed_flag : 0)), x(x), y(y),
+    width(transposed ? dimensions.height : dimensions.width), height(transposed ? dimensions.width : dimensions.height) {}
 
-unsigned int opt::Boxing::BoxedRectangle::x_end() const
+void opt::Boxing::Box::_account(const BoxedRectangle &rectangle, bool add)
 {
-    return x + (transposed ? rectangle->height : rectangle->width);
+    const unsigned long long area = rectangle.area();
+    const unsigned long long x_moment = (2ULL * rectangle.x + rectangle.width) * area;
+    const unsigned long long y_moment = (2ULL * rectangle.y + rectangle.height) * area;
+    if (add)
+    {
+        _area += area;
+        _x_moment += x_moment;
+        _y_moment += y_moment;
+    }
+    else
+    {
+        _area -= area;
+        _x_moment -= x_moment;
+        _y_moment -= y_moment;
+    }
 }
 
-unsigned int opt::Boxing::BoxedRectangle::y_end() const
+void opt::Boxing::Box::set(size_t i, const BoxedRectangle &rectangle)
 {
-    return y + (transposed ? rectangle->width : rectangle->height);
+    _account((*this)[i], false);
+    _account(rectangle, true);
+    const size_t n = size();
+    _rows[i] = rectangle.x;
+    _rows[n + i] = rectangle.y;
+    _rows[2 * n + i] = rectangle.width;
+    _rows[3 * n + i] = rectangle.height;
+    _rows[4 * n + i] = static_cast<unsigned short>(rectangle.item);
+    _rows[5 * n + i] = static_cast<unsigned short>(rectangle.item >> 16);
 }
 
-opt::Boxing::BoxImage opt::Boxing::_image_create() const
+void opt::Boxing::Box::push_back(const BoxedRectangle &rectangle)
 {
-    return BoxImage(_box_size * _box_size, false);
+    _account(rectangle, true);
+
+    //Rows are extended from the last one, so earlier row offsets stay valid
+    const size_t n = size();
+    _rows.push_back(static_cast<unsigned short>(rectangle.item >> 16));
+    _rows.insert(_rows.begin() + 5 * n, static_cast<unsigned short>(rectangle.item));
+    _rows.insert(_rows.begin() + 4 * n, rectangle.height);
+    _rows.insert(_rows.begin() + 3 * n, rectangle.width);
+    _rows.insert(_rows.begin() + 2 * n, rectangle.y);
+    _rows.insert(_rows.begin() + n, rectangle.x);
 }
 
-void opt::Boxing::_image_add(BoxImage *image, const BoxedRectangle &rectangle) const
+void opt::Boxing::Box::erase(size_t i)
 {
-    for (unsigned int y = rectangle.y; y < rectangle.y_end(); y++)
+    _account((*this)[i], false);
+    const size_t n = size();
+    for (size_t row = 6; row > 0; row--) _rows.erase(_rows.begin() + (row - 1) * n + i);
+}
+
+void opt::Boxing::Box::clear()
+{
+    _rows.clear();
+    _area = _x_moment = _y_moment = 0;
+}
+
+void opt::Boxing::Box::reserve(size_t size)
+{
+    _rows.reserve(6 * size);
+}
+
+size_t opt::Boxing::Box::memory_usage() const
+{
+    return sizeof(*this) + _rows.size() * sizeof(unsigned short);
+}
+
+opt::Boxing::Packing::Packing(const std::vector<Box> &boxes)
+{
+    for (auto box = boxes.cbegin(); box != boxes.cend(); box++)
     {
-        for (unsigned int x = rectangle.x; x < rectangle.x_end(); x++)
-        {
-            (*image)[_box_size * y + x] = true;
-        }
+        _boxes.push_back(std::make_shared<Box>(*box));
+        _rectangle_number += box->size();
+        _hash ^= _box_hash(_boxes.size() - 1, _boxes.size() - 1);
     }
 }
 
-void opt::Boxing::_image_add_all(BoxImage *image, const Box &box) const
+opt::Boxing::Packing::Packing(const Packing &packing) : _boxes(packing._boxes), _rectangle_number(packing._rectangle_number), _hash(packing._hash)
+{}
+
+opt::Boxing::Packing &opt::Boxing::Packing::operator=(const Packing &packing)
+{
+    //Packings reusing a neighbor slot mostly share boxes with the assigned one already, only different handles are replaced
+    const size_t common = std::min(_boxes.size(), packing._boxes.size());
+    for (size_t box = 0; box < common; box++)
+    {
+        if (_boxes[box] == packing._boxes[box]) continue;
+        _release(std::move(_boxes[box]));
+        _boxes[box] = packing._boxes[box];
+    }
+    for (size_t box = common; box < _boxes.size(); box++) _release(std::move(_boxes[box]));
+    _boxes.resize(common);
+    _boxes.insert(_boxes.end(), packing._boxes.begin() + common, packing._boxes.end());
+    _rectangle_number = packing._rectangle_number;
+    _hash = packing._hash;
+    return *this;
+}
+
+std::vector<opt::Boxing::Box> opt::Boxing::Packing::boxes() const
 {
-    for (auto rectangle = box.rectangles.cbegin(); rectangle != box.rectangles.cend(); rectangle++)
-        _image_add(image, *rectangle);
+    std::vector<Box> boxes;
+    for (auto box = _boxes.cbegin(); box != _boxes.cend(); box++) boxes.push_back(**box);
+    return boxes;
 }
 
-void opt::Boxing::_image_remove(BoxImage *image, const BoxedRectangle &rectangle) const
+size_t opt::Boxing::Packing::memory_usage() const
 {
-    for (unsigned int y = rectangle.y; y < rectangle.y_end(); y++)
+    size_t usage = copy_memory_usage();
+    for (auto box = _boxes.cbegin(); box != _boxes.cend(); box++) usage += (*box)->memory_usage();
+    return usage;
+}
+
+size_t opt::Boxing::Packing::copy_memory_usage() const
+{
+    return sizeof(*this) + _boxes.size() * sizeof(std::shared_ptr<Box>);
+}
+
+unsigned long long opt::Boxing::Packing::_key(size_t box, const BoxedRectangle &rectangle)
+{
+    return zobrist_key(box, rectangle.item | (static_cast<unsigned long long>(rectangle.x) << 32) | (static_cast<unsigned long long>(rectangle.y) << 48));
+}
+
+unsigned long long opt::Boxing::Packing::_box_hash(size_t box, size_t index) const
+{
+    unsigned long long hash = 0;
+    for (size_t i = 0; i < size(box); i++) hash ^= _key(index, get(box, i));
+    return hash;
+}
+
+std::vector<std::shared_ptr<opt::Boxing::Box>> &opt::Boxing::Packing::_spare()
+{
+    static thread_local std::vector<std::shared_ptr<Box>> spare;
+    return spare;
+}
+
+std::shared_ptr<opt::Boxing::Box> opt::Boxing::Packing::_take(const Box &box)
+{
+    //Boxes get room for twice the largest box copied by this thread, so they are rarely grown again
+    static thread_local size_t largest = 0;
+    if (box.size() + 1 > largest) largest = 2 * (box.size() + 1);
+    std::vector<std::shared_ptr<Box>> &spare = _spare();
+    std::shared_ptr<Box> taken;
+    if (spare.empty()) taken = std::make_shared<Box>();
+    else
     {
-        for (unsigned int x = rectangle.x; x < rectangle.x_end(); x++)
-        {
-            (*image)[_box_size * y + x] = false;
-        }
+        taken = std::move(spare.back());
+        spare.pop_back();
     }
+    taken->reserve(largest);
+    *taken = box;
+    return taken;
+}
+
+void opt::Boxing::Packing::_release(std::shared_ptr<Box> &&box)
+{
+    //Not bounded, neighbors change different numbers of boxes from one iteration to another and spare boxes never outnumber boxes they had
+    std::vector<std::shared_ptr<Box>> &spare = _spare();
+    if (box.use_count() == 1) spare.push_back(std::move(box));
+    else box.reset();
+}
+
+opt::Boxing::Box &opt::Boxing::Packing::_modify(size_t box)
+{
+    //Box owned only by this packing is modified in place
+    if (_boxes[box].use_count() != 1)
+    {
+        _boxes[box] = _take(*_boxes[box]);
+        OPTALG_COUNT(copied_bytes, _boxes[box]->memory_usage());
+    }
+    return *_boxes[box];
+}
+
+void opt::Boxing::Packing::set(size_t box, size_t i, const BoxedRectangle &rectangle)
+{
+    _hash ^= _key(box, get(box, i)) ^ _key(box, rectangle);
+    _modify(box).set(i, rectangle);
+}
+
+void opt::Boxing::Packing::move(size_t box, size_t i, size_t new_box, const BoxedRectangle &rectangle)
+{
+    _hash ^= _key(box, get(box, i)) ^ _key(new_box, rectangle);
+    if (new_box == _boxes.size())
+    {
+        _boxes.push_back(_take(Box()));
+        _boxes.back()->push_back(rectangle);
+    }
+    else _modify(new_box).push_back(rectangle);
+
+    if (_boxes[box]->size() == 1)
+    {
+        //Following boxes move to lower indices, which is the only change not hashed in constant time
+        _release(std::move(_boxes[box]));
+        _boxes.erase(_boxes.begin() + box);
+        for (size_t box_i = box; box_i < _boxes.size(); box_i++) _hash ^= _box_hash(box_i, box_i + 1) ^ _box_hash(box_i, box_i);
+    }
+    else _modify(box).erase(i);
+}
+
+opt::Boxing::Order::Order(const std::vector<unsigned int> &items) : _items(items)
+{
+    for (size_t i = 0; i < _items.size(); i++) _hash ^= _key(i, _items[i]);
+}
+
+unsigned long long opt::Boxing::Order::_key(size_t position, unsigned int item)
+{
+    return zobrist_key(position, item);
+}
+
+size_t opt::Boxing::Order::memory_usage() const
+{
+    return sizeof(*this) + _items.size() * sizeof(unsigned int);
+}
+
+void opt::Boxing::Order::swap(size_t i, size_t j)
+{
+    _hash ^= _key(i, _items[i]) ^ _key(j, _items[j]) ^ _key(i, _items[j]) ^ _key(j, _items[i]);
+    std::swap(_items[i], _items[j]);
+}
+
+void opt::Boxing::Order::move(size_t i, size_t new_i)
+{
+    //Every shifted item changes position, so hashing costs as much as moving
+    const size_t begin = std::min(i, new_i), end = std::max(i, new_i) + 1;
+    for (size_t j = begin; j < end; j++) _hash ^= _key(j, _items[j]);
+    const unsigned int item = _items[i];
+    if (i < new_i) std::copy(_items.begin() + i + 1, _items.begin() + new_i + 1, _items.begin() + i);
+    else std::copy_backward(_items.begin() + new_i, _items.begin() + i, _items.begin() + i + 1);
+    _items[new_i] = item;
+    for (size_t j = begin; j < end; j++) _hash ^= _key(j, _items[j]);
+}
+
+unsigned int opt::Boxing::_index(const Rectangle &rectangle) const
+{
+    return static_cast<unsigned int>(&rectangle - _rectangles.data());
+}
+
+opt::Boxing::BoxImage opt::Boxing::_image_create() const
+{
+    return BoxImage(_box_size * Grid::row_words(_box_size), 0);
+}
+
+void opt::Boxing::_image_add(BoxImage *image, const BoxedRectangle &rectangle) const
+{
+    OPTALG_COUNT(image_cells, rectangle.area());
+    _kernels->fill(image, _box_size, rectangle, true);
+}
+
+void opt::Boxing::_image_add_all(BoxImage *image, const Box &box) const
+{
+    for (size_t i = 0; i < box.size(); i++)
+        _image_add(image, box[i]);
+}
+
+void opt::Boxing::_image_add_all(BoxImage *image, const Packing &packing, size_t box) const
+{
+    _image_add_all(image, packing.box(box));
+}
+
+void opt::Boxing::_image_remove(BoxImage *image, const BoxedRectangle &rectangle) const
+{
+    OPTALG_COUNT(image_cells, rectangle.area());
+    _kernels->fill(image, _box_size, rectangle, false);
 }
 
 void opt::Boxing::_image_clear(BoxImage *image) const
 {
-    image->assign(_box_size * _box_size, false);
+    image->assign(_box_size * Grid::row_words(_box_size), 0);
 }
 
 std::pair<bool, opt::Boxing::BoxedRectangle> opt::Boxing::_can_transpose_center(const BoxedRectangle &rectangle) const
 {
-    const unsigned int width = rectangle.transposed ? rectangle.rectangle->height : rectangle.rectangle->width;
-    const unsigned int height = rectangle.transposed ? rectangle.rectangle->width : rectangle.rectangle->height;
+    const unsigned int width = rectangle.width;
+    const unsigned int height = rectangle.height;
     if (rectangle.x + width / 2 >= height / 2 && rectangle.y + height / 2 >= width / 2)
     {
-        BoxedRectangle transposed(*rectangle.rectangle,
+        BoxedRectangle transposed(rectangle.rectangle(), _rectangles[rectangle.rectangle()],
         rectangle.x + width / 2 - height / 2,
         rectangle.y + height / 2 - width / 2,
-        !rectangle.transposed);
+        !rectangle.transposed());
         return { true, transposed};
     }
     else return { false, rectangle };
@@ -78,43 +481,98 @@ bool opt::Boxing::_can_put_rectangle(const BoxedRectangle &rectangle) const
 bool opt::Boxing::_can_put_rectangle(const BoxedRectangle &rectangle, const BoxImage &image) const
 {
     if (!_can_put_rectangle(rectangle)) return false;
-
-    for (unsigned int y = rectangle.y; y < rectangle.y_end(); y++)
-    {
-        for (unsigned int x = rectangle.x; x < rectangle.x_end(); x++)
-        {
-            if (image[_box_size * y + x]) return false;
-        }
-    }
-    return true;
+    OPTALG_COUNT(probes, 1);
+    return _kernels->can_put(image, _box_size, rectangle);
 }
 
 std::pair<bool, opt::Boxing::BoxedRectangle> opt::Boxing::_can_put_rectangle(const Rectangle &rectangle, const BoxImage &image) const
 {
+    OPTALG_COUNT(searches, 1);
+
     //Try to fit horizontally
     const bool tall = rectangle.height > rectangle.width;
-    const unsigned int width = tall ? rectangle.height : rectangle.width;
-    const unsigned int height = tall ? rectangle.width : rectangle.height;
-    BoxedRectangle boxed_rectangle(rectangle, 0, 0, tall);
-    for (boxed_rectangle.y = 0; boxed_rectangle.y < _box_size - height + 1; boxed_rectangle.y++)
+    const unsigned int index = _index(rectangle);
+    BoxedRectangle boxed_rectangle(index, rectangle, 0, 0, tall);
+    if (_kernels->search(image, _box_size, &boxed_rectangle)) return { true, boxed_rectangle };
+
+    //Try to fit vertically
+    boxed_rectangle = BoxedRectangle(index, rectangle, 0, 0, !tall);
+    if (_kernels->search(image, _box_size, &boxed_rectangle)) return { true, boxed_rectangle };
+
+    return { false, boxed_rectangle };
+}
+
+void opt::Boxing::_shared_boxes(const Packing &previous, const Packing &packing, std::vector<size_t> *indices)
+{
+    //Shared boxes are never modified, so equal address means unchanged box, a skipped previous box was removed
+    indices->resize(packing.size());
+    size_t previous_box_i = 0;
+    for (size_t box_i = 0; box_i < packing.size(); box_i++, previous_box_i++)
     {
-        for (boxed_rectangle.x = 0; boxed_rectangle.x < _box_size - width + 1; boxed_rectangle.x++)
+        const Box *box = &packing.box(box_i);
+        if (previous_box_i + 1 < previous.size() && box != &previous.box(previous_box_i) && box == &previous.box(previous_box_i + 1)) previous_box_i++;
+        const bool shared = previous_box_i < previous.size() && box == &previous.box(previous_box_i);
+        (*indices)[box_i] = shared ? previous_box_i : previous.size();
+    }
+}
+
+unsigned int opt::Boxing::_function_bound(bool pairs) const
+{
+    //Dimensions and counts of shape classes
+    std::vector<std::pair<unsigned int, unsigned int>> shapes;
+    std::vector<unsigned long long> counts;
+    for (size_t i = 0; i < _rectangles.size(); i++)
+    {
+        if (_shape_classes[i] == shapes.size())
         {
-            if (_can_put_rectangle(boxed_rectangle, image)) return { true, boxed_rectangle };
+            shapes.push_back({ std::min(_rectangles[i].width, _rectangles[i].height), std::max(_rectangles[i].width, _rectangles[i].height) });
+            counts.push_back(0);
         }
+        counts[_shape_classes[i]]++;
     }
 
-    //Try to fit vertically
-    boxed_rectangle.transposed = !tall;
-    for (boxed_rectangle.y = 0; boxed_rectangle.y < _box_size - width + 1; boxed_rectangle.y++)
+    //Any pair of dual feasible functions applied to widths and heights gives a bound, rectangles take the orientation which is smaller
+    //Threshold functions change only at sizes of rectangles
+    std::vector<Function> functions;
+    for (unsigned int k = 1; k + 1 < _box_size; k++) functions.push_back({ Function::Type::rounding, k });
+    for (auto shape = shapes.cbegin(); shape != shapes.cend(); shape++)
     {
-        for (boxed_rectangle.x = 0; boxed_rectangle.x < _box_size - height + 1; boxed_rectangle.x++)
+        for (unsigned int size : { shape->first, shape->second })
         {
-            if (_can_put_rectangle(boxed_rectangle, image)) return { true, boxed_rectangle };
+            if (2 * size <= _box_size) functions.push_back({ Function::Type::threshold, size });
         }
     }
-
-    return { false, boxed_rectangle };
+    std::sort(functions.begin(), functions.end(), [](const Function &a, const Function &b)
+    {
+        return std::make_pair(a.type, a.parameter) < std::make_pair(b.type, b.parameter);
+    });
+    functions.erase(std::unique(functions.begin(), functions.end(), [](const Function &a, const Function &b)
+    {
+        return a.type == b.type && a.parameter == b.parameter;
+    }), functions.end());
+    const Function identity = { Function::Type::threshold, 0 };
+    functions.push_back(identity);
+
+    //Pairs are symmetric, so every function is paired with the identity once
+    unsigned int bound = 0;
+    for (auto f = functions.cbegin(); f != functions.cend(); f++)
+    {
+        for (auto g = pairs ? functions.cbegin() : functions.cend() - 1; g != functions.cend(); g++)
+        {
+            unsigned long long sum = 0;
+            for (size_t shape = 0; shape < shapes.size(); shape++)
+            {
+                const unsigned int a = shapes[shape].first, b = shapes[shape].second;
+                const unsigned long long value = std::min(
+                    static_cast<unsigned long long>((*f)(a, _box_size)) * (*g)(b, _box_size),
+                    static_cast<unsigned long long>((*f)(b, _box_size)) * (*g)(a, _box_size));
+                sum += value * counts[shape];
+            }
+            const unsigned long long scale = static_cast<unsigned long long>(f->scale(_box_size)) * g->scale(_box_size);
+            bound = std::max(bound, static_cast<unsigned int>((sum + scale - 1) / scale));
+        }
+    }
+    return bound;
 }
 
 unsigned int opt::Boxing::box_size() const
@@ -127,32 +585,85 @@ unsigned int opt::Boxing::box_area() const
     return _box_size * _box_size;
 }
 
+const std::vector<opt::Boxing::Rectangle> &opt::Boxing::rectangles() const
+{
+    return _rectangles;
+}
+
+unsigned int opt::Boxing::lower_bound() const
+{
+    return _lower_bound;
+}
+
 unsigned int opt::Boxing::_put_rectangle(const Rectangle &rectangle, std::vector<std::pair<Box, BoxImage>> *boxes) const
 {
+    size_t box_number = boxes->size();
+    return _put_rectangle(rectangle, boxes, &box_number);
+}
+
+size_t opt::Boxing::_open_box(std::vector<std::pair<Box, BoxImage>> *boxes, size_t *box_number) const
+{
+    if (*box_number < boxes->size())
+    {
+        (*boxes)[*box_number].first.clear();
+        _image_clear(&(*boxes)[*box_number].second);
+    }
+    else boxes->push_back({ Box(), _image_create() });
+    return (*box_number)++;
+}
+
+unsigned int opt::Boxing::_put_rectangle(const Rectangle &rectangle, std::vector<std::pair<Box, BoxImage>> *boxes, size_t *box_number) const
+{
+    OPTALG_COUNT(placements, 1);
+
     //Try to fit in existing boxes
-    for (unsigned int box_i = 0; box_i < boxes->size(); box_i++)
+    for (unsigned int box_i = 0; box_i < *box_number; box_i++)
     {
         std::pair<Box, BoxImage> &box = (*boxes)[box_i];
         std::pair<bool, BoxedRectangle> fit = _can_put_rectangle(rectangle, box.second);
         if (fit.first)
         {
-            box.first.rectangles.push_back(fit.second);
+            box.first.push_back(fit.second);
             _image_add(&box.second, fit.second);
             return box_i;
         }
     }
 
     //Fit in new box
-    boxes->push_back({ Box(), _image_create() });
-    BoxedRectangle boxed_rectangle(rectangle, 0, 0, rectangle.height > rectangle.width);
-    boxes->back().first.rectangles.push_back(boxed_rectangle);
-    _image_add(&boxes->back().second, boxed_rectangle);
-    return boxes->size() - 1;
+    const size_t box_i = _open_box(boxes, box_number);
+    BoxedRectangle boxed_rectangle(_index(rectangle), rectangle, 0, 0, rectangle.height > rectangle.width);
+    (*boxes)[box_i].first.push_back(boxed_rectangle);
+    _image_add(&(*boxes)[box_i].second, boxed_rectangle);
+    return static_cast<unsigned int>(box_i);
+}
+
+const opt::Boxing::Kernels *opt::Boxing::_select_kernels(unsigned int box_size)
+{
+    static const Kernels fixed8 = { &FixedGrid<8>::fill, &FixedGrid<8>::can_put, &FixedGrid<8>::search };
+    static const Kernels fixed10 = { &FixedGrid<10>::fill, &FixedGrid<10>::can_put, &FixedGrid<10>::search };
+    static const Kernels fixed16 = { &FixedGrid<16>::fill, &FixedGrid<16>::can_put, &FixedGrid<16>::search };
+    static const Kernels fixed32 = { &FixedGrid<32>::fill, &FixedGrid<32>::can_put, &FixedGrid<32>::search };
+    static const Kernels fixed50 = { &FixedGrid<50>::fill, &FixedGrid<50>::can_put, &FixedGrid<50>::search };
+    static const Kernels fixed64 = { &FixedGrid<64>::fill, &FixedGrid<64>::can_put, &FixedGrid<64>::search };
+    static const Kernels generic = { &Grid::fill, &Grid::can_put, &Grid::search };
+    switch (box_size)
+    {
+        case 8: return &fixed8;
+        case 10: return &fixed10;
+        case 16: return &fixed16;
+        case 32: return &fixed32;
+        case 50: return &fixed50;
+        case 64: return &fixed64;
+        default: return &generic;
+    }
 }
 
 opt::Boxing::Boxing(unsigned int box_size, unsigned int item_number, unsigned int item_size_min, unsigned int item_size_max, unsigned int seed)
-    : _box_size(box_size)
+    : _box_size(box_size), _kernels(_select_kernels(box_size))
 {
+    //Positions are stored in 16 bits, moves may reach up to twice the box size
+    if (box_size > std::numeric_limits<unsigned short>::max() / 2) throw std::runtime_error("Box size is too large");
+    if (item_number > BoxedRectangle::transposed_flag) throw std::runtime_error("Item number is too large");
     std::uniform_int_distribution<unsigned int> distribution(item_size_min, item_size_max);
     std::default_random_engine engine(seed);
 
@@ -160,6 +671,87 @@ opt::Boxing::Boxing(unsigned int box_size, unsigned int item_number, unsigned in
     {
         _rectangles.push_back(Rectangle(distribution(engine), distribution(engine)));
     }
+
+    //Group rectangles by shape, packing does not distinguish them
+    std::map<std::pair<unsigned int, unsigned int>, unsigned int> shape_classes;
+    std::vector<unsigned long long> shape_counts;
+    _shape_classes.reserve(item_number);
+    for (auto rectangle = _rectangles.cbegin(); rectangle != _rectangles.cend(); rectangle++)
+    {
+        const std::pair<unsigned int, unsigned int> shape(std::min(rectangle->width, rectangle->height), std::max(rectangle->width, rectangle->height));
+        _shape_classes.push_back(shape_classes.insert({ shape, static_cast<unsigned int>(shape_classes.size()) }).first->second);
+        shape_counts.resize(shape_classes.size(), 0);
+        shape_counts[_shape_classes.back()]++;
+    }
+
+    //Continuous bound
+    const unsigned long long area = box_area();
+    unsigned long long total_area = 0;
+    for (auto shape = shape_classes.cbegin(); shape != shape_classes.cend(); shape++)
+    {
+        total_area += static_cast<unsigned long long>(shape->first.first) * shape->first.second * shape_counts[shape->second];
+    }
+    _lower_bound = static_cast<unsigned int>((total_area + area - 1) / area);
+
+    //Martello and Vigo bound adapted to rotation: rectangles longer than half of box in both sides need a box each,
+    //those longer than box size - q leave no room for rectangles with both sides at least q, which fill the rest of other boxes by area
+    for (unsigned int q = 1; 2 * q <= box_size; q++)
+    {
+        unsigned long long huge = 0, large = 0, large_area = 0, small_area = 0;
+        for (auto shape = shape_classes.cbegin(); shape != shape_classes.cend(); shape++)
+        {
+            const unsigned int side = shape->first.first;
+            const unsigned long long count = shape_counts[shape->second];
+            const unsigned long long rectangle_area = static_cast<unsigned long long>(side) * shape->first.second;
+            if (side > box_size - q) huge += count;
+            else if (2 * side > box_size) { large += count; large_area += rectangle_area * count; }
+            else if (side >= q) small_area += rectangle_area * count;
+        }
+        const unsigned long long free_area = large * area - large_area;
+        const unsigned long long missing_area = (small_area > free_area) ? small_area - free_area : 0;
+        _lower_bound = std::max(_lower_bound, static_cast<unsigned int>(huge + large + (missing_area + area - 1) / area));
+    }
+
+    //Dual feasible functions paired with the identity, branch and bound tries all pairs
+    _lower_bound = std::max(_lower_bound, _function_bound(false));
+}
+
+void opt::Boxing::_energy(double *energy, const unsigned short *x, const unsigned short *y, const unsigned short *width, const unsigned short *height,
+    size_t size, unsigned int box_i, unsigned int cycle) const
+{
+    const unsigned int side = box_i % cycle;
+    for (size_t i = 0; i < size; i++)
+    {
+        double center = box_i * _box_size;
+        if (side == 0) center += static_cast<double>(2 * y[i] + height[i]) / 2;
+        else if (side == 1) center += static_cast<double>(2 * x[i] + width[i]) / 2;
+        else if (side == 2) center += static_cast<double>(_box_size - 2 * y[i] - height[i]) / 2;
+        else center += static_cast<double>(_box_size - 2 * x[i] - width[i]) / 2;
+        *energy += center * width[i] * height[i];
+    }
+}
+
+unsigned int opt::Boxing::_overlap_area(const unsigned short *x, const unsigned short *y, const unsigned short *width, const unsigned short *height, size_t size)
+{
+    unsigned int overlaps = 0;
+
+    //For every rectangle
+    for (size_t i = 0; i < size; i++)
+    {
+        const unsigned int x_end = x[i] + width[i];
+        const unsigned int y_end = y[i] + height[i];
+
+        //For every next rectangle
+        for (size_t j = i + 1; j < size; j++)
+        {
+            const unsigned int begin_x = std::max(x[i], x[j]);
+            const unsigned int begin_y = std::max(y[i], y[j]);
+            const unsigned int end_x = std::min(x_end, static_cast<unsigned int>(x[j] + width[j]));
+            const unsigned int end_y = std::min(y_end, static_cast<unsigned int>(y[j] + height[j]));
+            if (begin_x < end_x && begin_y < end_y) overlaps += (end_x - begin_x) * (end_y - begin_y);
+        }
+    }
+    return overlaps;
 }
 
 double opt::Boxing::energy(const std::vector<Box> &boxes, unsigned int cycle) const
@@ -168,15 +760,21 @@ double opt::Boxing::energy(const std::vector<Box> &boxes, unsigned int cycle) co
     for (unsigned int box_i = 0; box_i < boxes.size(); box_i++)
     {
         const Box &box = boxes[box_i];
-        for (auto rectangle = box.rectangles.cbegin(); rectangle != box.rectangles.cend(); rectangle++)
-        {
-            double height = box_i * _box_size;
-            if (box_i % cycle == 0) height += static_cast<double>(rectangle->y + rectangle->y_end()) / 2;
-            else if (box_i % cycle == 1) height += static_cast<double>(rectangle->x + rectangle->x_end()) / 2;
-            else if (box_i % cycle == 2) height += static_cast<double>(_box_size - rectangle->y - rectangle->y_end()) / 2;
-            else height += static_cast<double>(_box_size - rectangle->x - rectangle->x_end()) / 2;
-            energy += height * rectangle->rectangle->width * rectangle->rectangle->height;
-        }
+        _energy(&energy, box.x(), box.y(), box.width(), box.height(), box.size(), box_i, cycle);
+    }
+    return energy;
+}
+
+double opt::Boxing::energy(const Packing &packing, unsigned int cycle) const
+{
+    //Sums kept by boxes give the energy of the first two sides without visiting rectangles, exactly as summing them would
+    double energy = 0;
+    for (unsigned int box_i = 0; box_i < packing.size(); box_i++)
+    {
+        const Box &box = packing.box(box_i);
+        const unsigned int side = box_i % cycle;
+        if (side < 2) energy += static_cast<double>(box_i * _box_size) * box.area() + static_cast<double>((side == 0) ? box.y_moment() : box.x_moment()) / 2;
+        else _energy(&energy, box.x(), box.y(), box.width(), box.height(), box.size(), box_i, cycle);
     }
     return energy;
 }
@@ -187,10 +785,27 @@ bool opt::Boxing::has_overlaps(const std::vector<Box> &boxes) const
     for (auto box = boxes.cbegin(); box != boxes.cend(); box++)
     {
         if (image.empty()) image = _image_create(); else _image_clear(&image);
-        for (auto rectangle = box->rectangles.cbegin(); rectangle != box->rectangles.cend(); rectangle++)
+        for (size_t i = 0; i < box->size(); i++)
         {
-            if (!_can_put_rectangle(*rectangle, image)) return true;
-            _image_add(&image, *rectangle);
+            const BoxedRectangle rectangle = (*box)[i];
+            if (!_can_put_rectangle(rectangle, image)) return true;
+            _image_add(&image, rectangle);
+        }
+    }
+    return false;
+}
+
+bool opt::Boxing::has_overlaps(const Packing &packing) const
+{
+    BoxImage image;
+    for (size_t box_i = 0; box_i < packing.size(); box_i++)
+    {
+        if (image.empty()) image = _image_create(); else _image_clear(&image);
+        for (size_t i = 0; i < packing.size(box_i); i++)
+        {
+            const BoxedRectangle rectangle = packing.get(box_i, i);
+            if (!_can_put_rectangle(rectangle, image)) return true;
+            _image_add(&image, rectangle);
         }
     }
     return false;
@@ -209,19 +824,20 @@ unsigned int opt::Boxing::overlap_area(const BoxedRectangle &a, const BoxedRecta
 unsigned int opt::Boxing::overlap_area(const std::vector<Box> &boxes) const
 {
     unsigned int overlaps = 0;
-
-    //For every box
     for (auto box = boxes.cbegin(); box != boxes.cend(); box++)
     {
-        //For every rectangle
-        for (auto rectangle = box->rectangles.cbegin(); rectangle != box->rectangles.cend(); rectangle++)
-        {
-            //For every next rectangle
-            for (auto next_rectangle = rectangle + 1; next_rectangle != box->rectangles.cend(); next_rectangle++)
-            {
-                overlaps += overlap_area(*rectangle, *next_rectangle);
-            }
-        }
+        overlaps += _overlap_area(box->x(), box->y(), box->width(), box->height(), box->size());
+    }
+    return overlaps;
+}
+
+unsigned int opt::Boxing::overlap_area(const Packing &packing) const
+{
+    unsigned int overlaps = 0;
+    for (size_t box_i = 0; box_i < packing.size(); box_i++)
+    {
+        const Box &box = packing.box(box_i);
+        overlaps += _overlap_area(box.x(), box.y(), box.width(), box.height(), box.size());
     }
     return overlaps;
 }
@@ -229,9 +845,10 @@ unsigned int opt::Boxing::overlap_area(const std::vector<Box> &boxes) const
 unsigned int opt::Boxing::occupied_area(const Box &box) const
 {
     unsigned int occupied = 0;
-    for (auto rectangle = box.rectangles.cbegin(); rectangle != box.rectangles.cend(); rectangle++)
+    const unsigned short *width = box.width(), *height = box.height();
+    for (size_t i = 0; i < box.size(); i++)
     {
-        occupied += (rectangle->rectangle->width * rectangle->rectangle->height);
+        occupied += static_cast<unsigned int>(width[i]) * height[i];
     }
     return occupied;
 }
@@ -264,7 +881,7 @@ unsigned int opt::Boxing::rectangle_number(const std::vector<Box> &boxes, double
     for (auto box = boxes.cbegin(); box != boxes.cend(); box++)
     {
         const double occupation = static_cast<double>(occupied_area(*box)) / box_area();
-        if (occupation <= max_occupation) number += box->rectangles.size();
+        if (occupation <= max_occupation) number += box->size();
     }
     return number;
 }
@@ -272,11 +889,11 @@ unsigned int opt::Boxing::rectangle_number(const std::vector<Box> &boxes, double
 unsigned int opt::Boxing::least_rectangle_number(const std::vector<Box> &boxes, double max_occupation) const
 {
     if (boxes.empty()) return 0;
-    unsigned int number = boxes.front().rectangles.size();
+    unsigned int number = boxes.front().size();
     for (auto box = boxes.cbegin() + 1; box != boxes.cend(); box++)
     {
         const double occupation = static_cast<double>(occupied_area(*box)) / box_area();
-        if (occupation <= max_occupation) number = std::min(number, static_cast<unsigned int>(box->rectangles.size()));
+        if (occupation <= max_occupation) number = std::min(number, static_cast<unsigned int>(box->size()));
     }
     return number;
 }
\ No newline at end of file
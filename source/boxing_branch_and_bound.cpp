@@ -0,0 +1,162 @@
+#include "../include/optalg/boxing_branch_and_bound.h"
+#include <algorithm>
+#include <bitset>
+#include <stdexcept>
+#include <utility>
+
+opt::BoxingBranchAndBound::BoxingBranchAndBound(unsigned int box_size, unsigned int item_number, unsigned int item_size_min, unsigned int item_size_max,
+    unsigned int seed)
+    : Boxing(box_size, item_number, item_size_min, item_size_max, seed)
+{
+    if (item_size_max > box_size) throw std::runtime_error("Rectangles do not fit in box");
+
+    //Every node is pruned against the bound, so it is worth all pairs of dual feasible functions
+    _lower_bound = std::max(_lower_bound, _function_bound(true));
+
+    //Place large rectangles first, equal shapes one after another
+    _order.resize(_rectangles.size());
+    for (unsigned int i = 0; i < _order.size(); i++) _order[i] = i;
+    std::sort(_order.begin(), _order.end(), [this](unsigned int a, unsigned int b)
+    {
+        const unsigned long long a_area = static_cast<unsigned long long>(_rectangles[a].width) * _rectangles[a].height;
+        const unsigned long long b_area = static_cast<unsigned long long>(_rectangles[b].width) * _rectangles[b].height;
+        if (a_area != b_area) return a_area > b_area;
+        const unsigned int a_side = std::max(_rectangles[a].width, _rectangles[a].height);
+        const unsigned int b_side = std::max(_rectangles[b].width, _rectangles[b].height);
+        if (a_side != b_side) return a_side > b_side;
+        return a < b;
+    });
+    _remaining_area.assign(_order.size() + 1, 0);
+    _remaining_side.assign(_order.size() + 1, box_size);
+    for (size_t i = _order.size(); i-- > 0;)
+    {
+        const Rectangle &rectangle = _rectangles[_order[i]];
+        _remaining_area[i] = _remaining_area[i + 1] + static_cast<unsigned long long>(rectangle.width) * rectangle.height;
+        _remaining_side[i] = std::min(_remaining_side[i + 1], std::min(rectangle.width, rectangle.height));
+    }
+
+    //Pushed left, a rectangle touches the box or a rectangle to its left, and so on, so its coordinate sums sides of other rectangles
+    std::vector<bool> reachable(box_size, false);
+    reachable[0] = true;
+    for (auto rectangle = _rectangles.cbegin(); rectangle != _rectangles.cend(); rectangle++)
+    {
+        for (unsigned int position = box_size; position-- > 0;)
+        {
+            if (!reachable[position]) continue;
+            if (position + rectangle->width < box_size) reachable[position + rectangle->width] = true;
+            if (position + rectangle->height < box_size) reachable[position + rectangle->height] = true;
+        }
+    }
+    for (unsigned int position = 0; position < box_size; position++) if (reachable[position]) _positions.push_back(position);
+}
+
+unsigned int opt::BoxingBranchAndBound::_usable_area(const BoxImage &image, unsigned int side) const
+{
+    //Every free cell is usable by a unit square
+    unsigned int occupied = 0;
+    for (auto word = image.cbegin(); word != image.cend(); word++) occupied += static_cast<unsigned int>(std::bitset<64>(*word).count());
+    if (side <= 1) return box_area() - occupied;
+
+    //Mark cells of squares which fit
+    BoxImage covered = _image_create();
+    for (unsigned int y = 0; y + side <= _box_size; y++)
+    {
+        for (unsigned int x = 0; x + side <= _box_size; x++)
+        {
+            const BoxedRectangle square(0, Rectangle(side, side), x, y, false);
+            if (_can_put_rectangle(square, image)) _kernels->fill(&covered, _box_size, square, true);
+        }
+    }
+    unsigned int usable = 0;
+    for (auto word = covered.cbegin(); word != covered.cend(); word++) usable += static_cast<unsigned int>(std::bitset<64>(*word).count());
+    return usable;
+}
+
+opt::BoxingBranchAndBound::Node opt::BoxingBranchAndBound::root() const
+{
+    Node node;
+    node.bound = _lower_bound;
+    return node;
+}
+
+void opt::BoxingBranchAndBound::branch(const Node &node, std::vector<Node> *children) const
+{
+    //Restore images of boxes from placements
+    std::vector<BoxImage> images(node.box_number + 1, _image_create());
+    for (const Node *placed = &node; placed->depth != 0; placed = placed->parent.get()) _image_add(&images[placed->box], placed->placement);
+
+    //Free area which rectangles after this one may use
+    const unsigned int position = node.depth;
+    const unsigned int side = _remaining_side[position + 1];
+    unsigned long long usable = 0;
+    for (unsigned int box_i = 0; box_i < node.box_number; box_i++) usable += _usable_area(images[box_i], side);
+
+    //Rectangles of one shape are placed in increasing order of box and position, boxes are opened in order
+    const unsigned int index = _order[position];
+    const Rectangle &rectangle = _rectangles[index];
+    const bool follows_equal = position != 0 && _shape_classes[_order[position - 1]] == _shape_classes[index];
+    auto key = [this](unsigned int box_i, const BoxedRectangle &placement)
+    {
+        return ((static_cast<unsigned long long>(box_i) * _box_size + placement.y) * _box_size + placement.x) * 2 + (placement.transposed() ? 1 : 0);
+    };
+    const unsigned long long previous_key = follows_equal ? key(node.box, node.placement) : 0;
+
+    //Put rectangle at every free position of every box, the first empty box included
+    std::shared_ptr<const Node> parent = std::make_shared<const Node>(node);
+    const unsigned int orientations = (rectangle.width == rectangle.height) ? 1 : 2;
+    for (unsigned int box_i = 0; box_i <= node.box_number; box_i++)
+    {
+        const bool opened = box_i == node.box_number;
+        for (auto y = _positions.cbegin(); y != _positions.cend(); y++)
+        {
+            for (auto x = _positions.cbegin(); x != _positions.cend(); x++)
+            {
+                for (unsigned int orientation = 0; orientation < orientations; orientation++)
+                {
+                    const BoxedRectangle placement(index, rectangle, *x, *y, orientation == 1);
+                    if (follows_equal && key(box_i, placement) <= previous_key) continue;
+                    if (!_can_put_rectangle(placement, images[box_i])) continue;
+
+                    //Cells of the rectangle were usable if rectangles after it fit in it
+                    unsigned long long child_usable = usable + (opened ? box_area() : 0);
+                    if (std::min(placement.width, placement.height) >= side) child_usable -= placement.area();
+                    const unsigned long long remaining = _remaining_area[position + 1];
+                    const unsigned long long missing = (remaining > child_usable) ? remaining - child_usable : 0;
+
+                    Node child;
+                    child.parent = parent;
+                    child.placement = placement;
+                    child.box = box_i;
+                    child.depth = position + 1;
+                    child.box_number = node.box_number + (opened ? 1 : 0);
+                    child.bound = std::max(_lower_bound, child.box_number + static_cast<unsigned int>((missing + box_area() - 1) / box_area()));
+                    children->push_back(std::move(child));
+                }
+            }
+        }
+    }
+}
+
+double opt::BoxingBranchAndBound::bound(const Node &node) const
+{
+    return node.bound;
+}
+
+bool opt::BoxingBranchAndBound::complete(const Node &node) const
+{
+    return node.depth == _order.size();
+}
+
+double opt::BoxingBranchAndBound::cost(const Node &node) const
+{
+    return node.box_number;
+}
+
+std::vector<opt::Boxing::Box> opt::BoxingBranchAndBound::get_boxes(const Node &node) const
+{
+    std::vector<const Node *> placed;
+    for (const Node *n = &node; n->depth != 0; n = n->parent.get()) placed.push_back(n);
+    std::vector<Box> boxes(node.box_number);
+    for (auto n = placed.crbegin(); n != placed.crend(); n++) boxes[(*n)->box].push_back((*n)->placement);
+    return boxes;
+}
@@ -0,0 +1,141 @@
+#include "../include/optalg/boxing_large_neighborhood.h"
+#include <algorithm>
+#include <cmath>
+
+opt::BoxingLargeNeighborhood::BoxingLargeNeighborhood(unsigned int box_size, unsigned int item_number, unsigned int item_size_min, unsigned int item_size_max,
+    unsigned int seed, unsigned int ruin_boxes, unsigned int ruin_nearby)
+    : Boxing(box_size, item_number, item_size_min, item_size_max, seed), _ruin_boxes(ruin_boxes), _ruin_nearby(ruin_nearby), _total_area(0)
+{
+    for (auto rectangle = _rectangles.cbegin(); rectangle != _rectangles.cend(); rectangle++)
+    {
+        _total_area += static_cast<unsigned long long>(rectangle->width) * rectangle->height;
+    }
+}
+
+opt::BoxingLargeNeighborhood::Solution opt::BoxingLargeNeighborhood::initial(unsigned int) const
+{
+    //Pack as greedy by area
+    Partial partial;
+    partial.removed.resize(_rectangles.size());
+    for (unsigned int i = 0; i < partial.removed.size(); i++) partial.removed[i] = i;
+    return recreate(partial, 0, 0);
+}
+
+opt::BoxingLargeNeighborhood::Partial opt::BoxingLargeNeighborhood::ruin(const Solution &solution, std::default_random_engine &engine) const
+{
+    //Choose boxes to empty, cube of uniform variable favors the least occupied ones
+    std::vector<std::pair<unsigned int, unsigned int>> occupation;
+    occupation.reserve(solution.size());
+    for (unsigned int box_i = 0; box_i < solution.size(); box_i++) occupation.push_back({ occupied_area(solution[box_i].first), box_i });
+    std::sort(occupation.begin(), occupation.end());
+    std::vector<bool> emptied(solution.size(), false);
+    std::uniform_real_distribution<double> uniform(0.0, 1.0);
+    for (unsigned int k = 0; k < _ruin_boxes && !occupation.empty(); k++)
+    {
+        const size_t pick = std::min(static_cast<size_t>(std::pow(uniform(engine), 3) * occupation.size()), occupation.size() - 1);
+        emptied[occupation[pick].second] = true;
+        occupation.erase(occupation.begin() + pick);
+    }
+
+    //Find rectangles of other boxes with free space right of them or above them
+    std::vector<std::pair<unsigned int, unsigned int>> nearby;
+    for (unsigned int box_i = 0; box_i < solution.size(); box_i++)
+    {
+        if (emptied[box_i]) continue;
+        const Box &box = solution[box_i].first;
+        const BoxImage &image = solution[box_i].second;
+        for (unsigned int rectangle_i = 0; rectangle_i < box.size(); rectangle_i++)
+        {
+            const BoxedRectangle rectangle = box[rectangle_i];
+            BoxedRectangle right = rectangle, above = rectangle;
+            right.x = rectangle.x_end();
+            right.width = 1;
+            above.y = rectangle.y_end();
+            above.height = 1;
+            if (_can_put_rectangle(right, image) || _can_put_rectangle(above, image)) nearby.push_back({ box_i, rectangle_i });
+        }
+    }
+    std::shuffle(nearby.begin(), nearby.end(), engine);
+    if (nearby.size() > _ruin_nearby) nearby.resize(_ruin_nearby);
+    std::sort(nearby.begin(), nearby.end(), [](const std::pair<unsigned int, unsigned int> &a, const std::pair<unsigned int, unsigned int> &b)
+    {
+        return a.first < b.first || (a.first == b.first && a.second > b.second);
+    });
+
+    //Remove, boxes left empty are dropped
+    Partial partial;
+    auto removal = nearby.cbegin();
+    for (unsigned int box_i = 0; box_i < solution.size(); box_i++)
+    {
+        const Box &box = solution[box_i].first;
+        if (emptied[box_i])
+        {
+            for (size_t rectangle_i = 0; rectangle_i < box.size(); rectangle_i++) partial.removed.push_back(box[rectangle_i].rectangle());
+            continue;
+        }
+        partial.boxes.push_back(solution[box_i]);
+        std::pair<Box, BoxImage> &kept = partial.boxes.back();
+        for (; removal != nearby.cend() && removal->first == box_i; removal++)
+        {
+            const BoxedRectangle rectangle = kept.first[removal->second];
+            partial.removed.push_back(rectangle.rectangle());
+            _image_remove(&kept.second, rectangle);
+            kept.first.erase(removal->second);
+        }
+        if (kept.first.empty()) partial.boxes.pop_back();
+    }
+    OPTALG_COUNT(copied_bytes, memory_usage(partial.boxes));
+    return partial;
+}
+
+opt::BoxingLargeNeighborhood::Solution opt::BoxingLargeNeighborhood::recreate(const Partial &partial, unsigned int ordering, unsigned int seed) const
+{
+    //First orderings are those of greedy, others are random
+    std::vector<unsigned int> removed = partial.removed;
+    auto sort = [this, &removed](unsigned long long (*metric)(const Rectangle &))
+    {
+        std::sort(removed.begin(), removed.end(), [this, metric](unsigned int a, unsigned int b)
+        {
+            const unsigned long long a_metric = metric(_rectangles[a]), b_metric = metric(_rectangles[b]);
+            return a_metric > b_metric || (a_metric == b_metric && a < b);
+        });
+    };
+    if (ordering == 0) sort([](const Rectangle &r) { return static_cast<unsigned long long>(r.width) * r.height; });
+    else if (ordering == 1) sort([](const Rectangle &r) { return static_cast<unsigned long long>(std::max(r.width, r.height)); });
+    else if (ordering == 2) sort([](const Rectangle &r) { return static_cast<unsigned long long>(std::min(r.width, r.height)); });
+    else
+    {
+        std::default_random_engine engine(seed);
+        std::shuffle(removed.begin(), removed.end(), engine);
+    }
+
+    //Pack
+    Solution solution = partial.boxes;
+    OPTALG_COUNT(copied_bytes, memory_usage(solution));
+    for (auto rectangle = removed.cbegin(); rectangle != removed.cend(); rectangle++) _put_rectangle(_rectangles[*rectangle], &solution);
+    return solution;
+}
+
+double opt::BoxingLargeNeighborhood::heuristic(const Solution &solution, unsigned int) const
+{
+    //Box number comes first, energy scaled below one breaks ties
+    double value = 0;
+    for (unsigned int box_i = 0; box_i < solution.size(); box_i++)
+    {
+        const Box &box = solution[box_i].first;
+        _energy(&value, box.x(), box.y(), box.width(), box.height(), box.size(), box_i, 1);
+    }
+    return solution.size() + value / (static_cast<double>(_total_area) * solution.size() * _box_size + 1);
+}
+
+bool opt::BoxingLargeNeighborhood::optimal(const Solution &solution) const
+{
+    return solution.size() <= _lower_bound;
+}
+
+std::vector<opt::Boxing::Box> opt::BoxingLargeNeighborhood::get_boxes(const Solution &solution) const
+{
+    std::vector<opt::Boxing::Box> boxes;
+    for (auto box = solution.begin(); box != solution.end(); box++) boxes.push_back(box->first);
+    return boxes;
+}
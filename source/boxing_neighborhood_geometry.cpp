@@ -1,10 +1,11 @@
 #include "../include/optalg/boxing_neighborhood.h"
+#include <algorithm>
 #include <random>
 #include <vector>
 
 opt::BoxingNeighborhoodGeometry::BoxingNeighborhoodGeometry(unsigned int box_size, unsigned int item_number, unsigned int item_size_min, unsigned int item_size_max,
-    unsigned int seed, unsigned int window, unsigned int hwindow)
-    : Boxing(box_size, item_number, item_size_min, item_size_max, seed), _window(window), _hwindow(hwindow)
+    unsigned int seed, unsigned int window, unsigned int hwindow, size_t cache_size, bool slide)
+    : Boxing(box_size, item_number, item_size_min, item_size_max, seed), _window(window), _hwindow(hwindow), _cache(cache_size), _slide(slide)
 {}
 
 opt::BoxingNeighborhoodGeometry::Solution opt::BoxingNeighborhoodGeometry::initial(unsigned int seed) const
@@ -18,7 +19,7 @@ opt::BoxingNeighborhoodGeometry::Solution opt::BoxingNeighborhoodGeometry::initi
         //Randomly generate position
         std::uniform_int_distribution<unsigned int> x_distribution(0, _box_size - rectangle->width);
         std::uniform_int_distribution<unsigned int> y_distribution(0, _box_size - rectangle->height);
-        BoxedRectangle boxed_rectangle(*rectangle, x_distribution(engine), y_distribution(engine), false);
+        BoxedRectangle boxed_rectangle(_index(*rectangle), *rectangle, x_distribution(engine), y_distribution(engine), false);
 
         //Try to fit in last box
         const bool fit = !boxes.empty() && _can_put_rectangle(boxed_rectangle, image);
@@ -31,86 +32,101 @@ opt::BoxingNeighborhoodGeometry::Solution opt::BoxingNeighborhoodGeometry::initi
         }
 
         //Put in box
-        boxes.back().rectangles.push_back(boxed_rectangle);
+        boxes.back().push_back(boxed_rectangle);
         _image_add(&image, boxed_rectangle);
     }
-    return boxes;
+    return Packing(boxes);
 }
 
-opt::BoxingNeighborhoodGeometry::SolutionContainer opt::BoxingNeighborhoodGeometry::neighbors(const Solution &solution,
-    std::default_random_engine &, unsigned int id, unsigned int nthreads) const
+double opt::BoxingNeighborhoodGeometry::prepare(const Solution &solution, unsigned int iter, Context *context) const
 {
-    std::vector<BoxImage> images((_hwindow != 0) ? (2 * _hwindow + 1) : (solution.size()));
-    std::vector<std::vector<Box>> neighborhood;
-
-    //Create cache
-    const unsigned int begin_box_i = solution.size() * id / nthreads;
-    const unsigned int end_box_i = solution.size() * (id + 1) / nthreads;
-    for (unsigned int box_j = ((_hwindow != 0) ? (std::max(begin_box_i, _hwindow) - _hwindow) : 0);
-        ((_hwindow != 0) ? (box_j <= begin_box_i + _hwindow) : true) && box_j < solution.size();
-        box_j++)
+    //Accepted move changes at most two boxes and may remove one, images of boxes shared with the previous solution are kept
+    static thread_local std::vector<size_t> shared;
+    _shared_boxes(context->packing, solution, &shared);
+    std::vector<BoxImage> &images = context->images;
+    images.resize(std::max(images.size(), solution.size()));
+    for (unsigned int box_i = 0; box_i < solution.size(); box_i++)
     {
-        BoxImage &dest_image = (_hwindow != 0) ? images[_hwindow + box_j - begin_box_i] : images[box_j];
-        dest_image = _image_create();
-        _image_add_all(&dest_image, solution[box_j]);
+        if (shared[box_i] != context->packing.size())
+        {
+            if (shared[box_i] != box_i) std::swap(images[box_i], images[shared[box_i]]);
+        }
+        else
+        {
+            _image_clear(&images[box_i]);
+            _image_add_all(&images[box_i], solution, box_i);
+        }
     }
+    images.resize(solution.size());
+    context->packing = solution;
+    return heuristic(solution, iter);
+}
+
+void opt::BoxingNeighborhoodGeometry::neighbors(const Solution &solution, const Context &context,
+    std::default_random_engine &, Neighbors<Solution> *neighborhood, unsigned int id, unsigned int nthreads) const
+{
+    //Image of the box without the moved rectangle is kept by the calling thread, images of other boxes are shared
+    static thread_local BoxImage image;
 
     //For every box
+    const unsigned int begin_box_i = solution.size() * id / nthreads;
+    const unsigned int end_box_i = solution.size() * (id + 1) / nthreads;
     for (unsigned int box_i = begin_box_i; box_i < end_box_i; box_i++)
     {
-        const Box &box = solution[box_i];
-        BoxImage &image = (_hwindow != 0) ? images[_hwindow] : images[box_i];
+        image = context.images[box_i];
 
         //For every rectangle
-        for (unsigned int rectangle_i = 0; rectangle_i < box.rectangles.size(); rectangle_i++)
+        for (unsigned int rectangle_i = 0; rectangle_i < solution.size(box_i); rectangle_i++)
         {
-            const BoxedRectangle &rectangle = box.rectangles[rectangle_i];
+            const BoxedRectangle rectangle = solution.get(box_i, rectangle_i);
             _image_remove(&image, rectangle);
+            if (_slide) _slides(solution, context, image, box_i, rectangle_i, neighborhood);
 
             //For every neighboring box
             for (unsigned int box_j = ((_hwindow != 0) ? (std::max(box_i, _hwindow) - _hwindow) : 0);
                 ((_hwindow != 0) ? (box_j <= box_i + _hwindow) : true) && box_j < solution.size();
                 box_j++)
             {
-                const BoxImage &dest_image = (_hwindow != 0) ? images[_hwindow + box_j - box_i] : images[box_j];
+                const BoxImage &dest_image = (box_j == box_i) ? image : context.images[box_j];
 
                 //For every neighboring y
                 BoxedRectangle move = rectangle;
-                for (move.y = std::max(rectangle.y, _window) - _window;
-                    move.y <= rectangle.y + _window;
-                    move.y++)
+                for (unsigned int y = std::max<unsigned int>(rectangle.y, _window) - _window;
+                    y <= rectangle.y + _window && y <= _box_size;
+                    y++)
                 {
                     //For every neighboring x
-                    for (move.x = std::max(rectangle.x, _window) - _window;
-                        move.x <= rectangle.x + _window;
-                        move.x++)
+                    for (unsigned int x = std::max<unsigned int>(rectangle.x, _window) - _window;
+                        x <= rectangle.x + _window && x <= _box_size;
+                        x++)
                     {
                         //Dismiss no-move
-                        if (box_j == box_i && move.y == rectangle.y && move.x == rectangle.x) continue;
+                        if (box_j == box_i && y == rectangle.y && x == rectangle.x) continue;
+                        move.x = x;
+                        move.y = y;
 
                         //Check non-transposed move
                         if (_can_put_rectangle(move, dest_image))
                         {
-                            neighborhood.push_back(solution);
-                            if (box_j != box_i)
-                            {
-                                neighborhood.back()[box_i].rectangles.erase(neighborhood.back()[box_i].rectangles.begin() + rectangle_i);
-                                neighborhood.back()[box_j].rectangles.push_back(move);
-                            }
-                            else neighborhood.back()[box_i].rectangles[rectangle_i] = move;
+                            Solution &neighbor = neighborhood->push(solution);
+                            OPTALG_COUNT(copied_bytes, solution.copy_memory_usage());
+                            if (box_j != box_i) neighbor.move(box_i, rectangle_i, box_j, move);
+                            else neighbor.set(box_i, rectangle_i, move);
                         }
 
-                        //Check transposed move
+                        //Check transposed move, transposed square is the same move
+                        if (move.width == move.height)
+                        {
+                            OPTALG_COUNT(dropped, 1);
+                            continue;
+                        }
                         std::pair<bool, BoxedRectangle> transposed_move = _can_transpose_center(move);
                         if (transposed_move.first && _can_put_rectangle(transposed_move.second, dest_image))
                         {
-                            neighborhood.push_back(solution);
-                            if (box_j != box_i)
-                            {
-                                neighborhood.back()[box_i].rectangles.erase(neighborhood.back()[box_i].rectangles.begin() + rectangle_i);
-                                neighborhood.back()[box_j].rectangles.push_back(transposed_move.second);
-                            }
-                            else neighborhood.back()[box_i].rectangles[rectangle_i] = transposed_move.second;
+                            Solution &neighbor = neighborhood->push(solution);
+                            OPTALG_COUNT(copied_bytes, solution.copy_memory_usage());
+                            if (box_j != box_i) neighbor.move(box_i, rectangle_i, box_j, transposed_move.second);
+                            else neighbor.set(box_i, rectangle_i, transposed_move.second);
                         }
                     }
                 }
@@ -118,40 +134,64 @@ opt::BoxingNeighborhoodGeometry::SolutionContainer opt::BoxingNeighborhoodGeomet
 
             _image_add(&image, rectangle);
         }
+    }
+}
+
+void opt::BoxingNeighborhoodGeometry::_slides(const Solution &solution, const Context &context, const BoxImage &image, unsigned int box_i, unsigned int rectangle_i,
+    Neighbors<Solution> *neighborhood) const
+{
+    const BoxedRectangle rectangle = solution.get(box_i, rectangle_i);
+
+    //Down, left and down-left, every step checks only the row and column entered by the rectangle
+    const unsigned int steps[3][2] = { { 0, 1 }, { 1, 0 }, { 1, 1 } };
+    for (unsigned int direction = 0; direction < 3; direction++)
+    {
+        const unsigned int step_x = steps[direction][0], step_y = steps[direction][1];
+        BoxedRectangle move = rectangle;
+        while (move.x >= step_x && move.y >= step_y)
+        {
+            BoxedRectangle row = move, column = move;
+            row.x -= step_x;
+            row.y -= step_y;
+            row.height = 1;
+            column.x -= step_x;
+            column.y -= step_y;
+            column.width = 1;
+            if ((step_y != 0 && !_can_put_rectangle(row, image)) || (step_x != 0 && !_can_put_rectangle(column, image))) break;
+            move.x -= step_x;
+            move.y -= step_y;
+        }
 
-        //Shift cache
-        if (_hwindow != 0)
+        //Shorter slides are moves within window
+        if (static_cast<unsigned int>(rectangle.x - move.x) > _window || static_cast<unsigned int>(rectangle.y - move.y) > _window)
         {
-            for (unsigned int i = 0; i < images.size() - 1; i++)
-            {
-                images[i] = std::move(images[i + 1]);
-            }
-            if ((box_i + 1) + _hwindow < solution.size())
-            {
-                images.back() = _image_create();
-                _image_add_all(&images.back(), solution[(box_i + 1) + _hwindow]);
-            }
+            Solution &neighbor = neighborhood->push(solution);
+            OPTALG_COUNT(copied_bytes, solution.copy_memory_usage());
+            neighbor.set(box_i, rectangle_i, move);
         }
     }
 
-    //Remove empty boxes
-    for (auto neighbor = neighborhood.begin(); neighbor != neighborhood.end(); neighbor++)
+    //Lowest free position in the first earlier box which has one
+    for (unsigned int box_j = 0; box_j < box_i; box_j++)
     {
-        for (unsigned int box_i = neighbor->size(); box_i > 0; box_i--)
+        const std::pair<bool, BoxedRectangle> move = _can_put_rectangle(_rectangles[rectangle.rectangle()], context.images[box_j]);
+        if (move.first)
         {
-            if ((*neighbor)[box_i - 1].rectangles.empty())
-            {
-                neighbor->erase(neighbor->begin() + box_i - 1);
-            }
+            Solution &neighbor = neighborhood->push(solution);
+            OPTALG_COUNT(copied_bytes, solution.copy_memory_usage());
+            neighbor.move(box_i, rectangle_i, box_j, move.second);
+            break;
         }
     }
-
-    return neighborhood;
 }
 
 double opt::BoxingNeighborhoodGeometry::heuristic(const Solution &solution, unsigned int) const
 {
-    return energy(solution);
+    double value;
+    if (_cache.find(solution.hash(), &value)) return value;
+    value = energy(solution);
+    _cache.insert(solution.hash(), value);
+    return value;
 }
 
 bool opt::BoxingNeighborhoodGeometry::good(const Solution &, unsigned int) const
@@ -159,7 +199,12 @@ bool opt::BoxingNeighborhoodGeometry::good(const Solution &, unsigned int) const
     return true;
 }
 
+bool opt::BoxingNeighborhoodGeometry::optimal(const Solution &solution, const Context &) const
+{
+    return solution.size() <= _lower_bound;
+}
+
 std::vector<opt::Boxing::Box> opt::BoxingNeighborhoodGeometry::get_boxes(const Solution &solution) const
 {
-    return solution;
+    return solution.boxes();
 }
\ No newline at end of file
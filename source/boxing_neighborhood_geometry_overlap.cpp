@@ -1,13 +1,15 @@
 #include "../include/optalg/boxing_neighborhood.h"
+#include <algorithm>
 #include <random>
+#include <vector>
 #ifdef DEBUG_OVERLAPS
     #include <limits>
     #include <iostream>
 #endif
 
 opt::BoxingNeighborhoodGeometryOverlap::BoxingNeighborhoodGeometryOverlap(unsigned int box_size, unsigned int item_number, unsigned int item_size_min, unsigned int item_size_max,
-    unsigned int seed, unsigned int window, unsigned int hwindow, unsigned int desired_iter)
-    : Boxing(box_size, item_number, item_size_min, item_size_max, seed), _window(window),  _hwindow(hwindow), _desired_iter(desired_iter)
+    unsigned int seed, unsigned int window, unsigned int hwindow, unsigned int desired_iter, unsigned int focus)
+    : Boxing(box_size, item_number, item_size_min, item_size_max, seed), _window(window),  _hwindow(hwindow), _desired_iter(desired_iter), _focus(focus)
 {}
 
 opt::BoxingNeighborhoodGeometryOverlap::Solution opt::BoxingNeighborhoodGeometryOverlap::initial(unsigned int seed) const
@@ -20,18 +22,56 @@ opt::BoxingNeighborhoodGeometryOverlap::Solution opt::BoxingNeighborhoodGeometry
         //Randomly generate position
         std::uniform_int_distribution<unsigned int> x_distribution(0, _box_size - rectangle->width);
         std::uniform_int_distribution<unsigned int> y_distribution(0, _box_size - rectangle->height);
-        BoxedRectangle boxed_rectangle(*rectangle, x_distribution(engine), y_distribution(engine), false);
+        BoxedRectangle boxed_rectangle(_index(*rectangle), *rectangle, x_distribution(engine), y_distribution(engine), false);
 
         //Put in box
-        boxes[0].rectangles.push_back(boxed_rectangle);
+        boxes[0].push_back(boxed_rectangle);
     }
-    return boxes;
+    return Packing(boxes);
 }
 
-opt::BoxingNeighborhoodGeometryOverlap::SolutionContainer opt::BoxingNeighborhoodGeometryOverlap::neighbors(const Solution &solution,
-    std::default_random_engine &, unsigned int id, unsigned int nthreads) const
+double opt::BoxingNeighborhoodGeometryOverlap::prepare(const Solution &solution, unsigned int iter, Context *context) const
 {
-    std::vector<std::vector<Box>> neighborhood;
+    if (_focus == 0) return heuristic(solution, iter);
+
+    //Accepted move changes at most two boxes and may remove one, overlaps are found again only in changed boxes
+    static thread_local std::vector<size_t> shared;
+    _shared_boxes(context->packing, solution, &shared);
+    std::vector<std::vector<bool>> &overlapping = context->overlapping;
+    overlapping.resize(std::max(overlapping.size(), solution.size()));
+    context->overlapping_number = 0;
+    for (unsigned int box_i = 0; box_i < solution.size(); box_i++)
+    {
+        std::vector<bool> &box_overlapping = overlapping[box_i];
+        if (shared[box_i] != context->packing.size())
+        {
+            if (shared[box_i] != box_i) std::swap(box_overlapping, overlapping[shared[box_i]]);
+        }
+        else
+        {
+            const Box &box = solution.box(box_i);
+            box_overlapping.assign(box.size(), false);
+            for (size_t i = 0; i < box.size(); i++)
+            {
+                for (size_t j = i + 1; j < box.size(); j++)
+                {
+                    if (overlap_area(box[i], box[j]) != 0) box_overlapping[i] = box_overlapping[j] = true;
+                }
+            }
+        }
+        context->overlapping_number += std::count(box_overlapping.cbegin(), box_overlapping.cend(), true);
+    }
+    overlapping.resize(solution.size());
+    context->packing = solution;
+    return heuristic(solution, iter);
+}
+
+void opt::BoxingNeighborhoodGeometryOverlap::neighbors(const Solution &solution, const Context &context,
+    std::default_random_engine &engine, Neighbors<Solution> *neighborhood, unsigned int id, unsigned int nthreads) const
+{
+    //Rectangles without overlaps are sampled when focused
+    const size_t other_number = solution.rectangle_number() - context.overlapping_number;
+    std::bernoulli_distribution sample((other_number == 0) ? 1.0 : std::min(1.0, static_cast<double>(_focus) / other_number));
 
     //For every box
     const unsigned int begin_box_i = solution.size() * id / nthreads;
@@ -39,10 +79,10 @@ opt::BoxingNeighborhoodGeometryOverlap::SolutionContainer opt::BoxingNeighborhoo
     for (unsigned int box_i = begin_box_i; box_i < end_box_i; box_i++)
     {
         //For every rectangle
-        const Box &box = solution[box_i];
-        for (unsigned int rectangle_i = 0; rectangle_i < box.rectangles.size(); rectangle_i++)
+        for (unsigned int rectangle_i = 0; rectangle_i < solution.size(box_i); rectangle_i++)
         {
-            const BoxedRectangle &rectangle = box.rectangles[rectangle_i];
+            if (_focus != 0 && !context.overlapping[box_i][rectangle_i] && !sample(engine)) continue;
+            const BoxedRectangle rectangle = solution.get(box_i, rectangle_i);
 
             //For every neighboring box
             for (unsigned int box_j = ((_hwindow != 0) ? (std::max(box_i, _hwindow) - _hwindow) : 0);
@@ -51,63 +91,48 @@ opt::BoxingNeighborhoodGeometryOverlap::SolutionContainer opt::BoxingNeighborhoo
             {
                 //For every neighboring y
                 BoxedRectangle move = rectangle;
-                for (move.y = std::max(rectangle.y, _window) - _window;
-                    move.y <= rectangle.y + _window;
-                    move.y++)
+                for (unsigned int y = std::max<unsigned int>(rectangle.y, _window) - _window;
+                    y <= rectangle.y + _window && y <= _box_size;
+                    y++)
                 {
                     //For every neighboring x
-                    for (move.x = std::max(rectangle.x, _window) - _window;
-                        move.x <= rectangle.x + _window;
-                        move.x++)
+                    for (unsigned int x = std::max<unsigned int>(rectangle.x, _window) - _window;
+                        x <= rectangle.x + _window && x <= _box_size;
+                        x++)
                     {
                         //Dismiss no-move
-                        if (box_j == box_i && move.y == rectangle.y && move.x == rectangle.x) continue;
+                        if (box_j == box_i && y == rectangle.y && x == rectangle.x) continue;
+                        move.x = x;
+                        move.y = y;
 
                         //Check non-transposed move
                         if (_can_put_rectangle(move))
                         {
-                            neighborhood.push_back(solution);
-                            if (box_j != box_i)
-                            {
-                                if (box_j == neighborhood.back().size()) neighborhood.back().push_back(Box());
-                                neighborhood.back()[box_i].rectangles.erase(neighborhood.back()[box_i].rectangles.begin() + rectangle_i);
-                                neighborhood.back()[box_j].rectangles.push_back(move);
-                            }
-                            else neighborhood.back()[box_i].rectangles[rectangle_i] = move;
+                            Solution &neighbor = neighborhood->push(solution);
+                            OPTALG_COUNT(copied_bytes, solution.copy_memory_usage());
+                            if (box_j != box_i) neighbor.move(box_i, rectangle_i, box_j, move);
+                            else neighbor.set(box_i, rectangle_i, move);
                         }
 
-                        //Check transposed move
+                        //Check transposed move, transposed square is the same move
+                        if (move.width == move.height)
+                        {
+                            OPTALG_COUNT(dropped, 1);
+                            continue;
+                        }
                         std::pair<bool, BoxedRectangle> transposed_move = _can_transpose_center(move);
                         if (transposed_move.first && _can_put_rectangle(transposed_move.second))
                         {
-                            neighborhood.push_back(solution);
-                            if (box_j != box_i)
-                            {
-                                if (box_j == neighborhood.back().size()) neighborhood.back().push_back(Box());
-                                neighborhood.back()[box_i].rectangles.erase(neighborhood.back()[box_i].rectangles.begin() + rectangle_i);
-                                neighborhood.back()[box_j].rectangles.push_back(transposed_move.second);
-                            }
-                            else neighborhood.back()[box_i].rectangles[rectangle_i] = transposed_move.second;
+                            Solution &neighbor = neighborhood->push(solution);
+                            OPTALG_COUNT(copied_bytes, solution.copy_memory_usage());
+                            if (box_j != box_i) neighbor.move(box_i, rectangle_i, box_j, transposed_move.second);
+                            else neighbor.set(box_i, rectangle_i, transposed_move.second);
                         }
                     }
                 }
             }
         }
     }
-
-    //Remove empty boxes
-    for (auto neighbor = neighborhood.begin(); neighbor != neighborhood.end(); neighbor++)
-    {
-        for (unsigned int box_i = neighbor->size(); box_i > 0; box_i--)
-        {
-            if ((*neighbor)[box_i - 1].rectangles.empty())
-            {
-                neighbor->erase(neighbor->begin() + box_i - 1);
-            }
-        }
-    }
-
-    return neighborhood;
 }
 
 double opt::BoxingNeighborhoodGeometryOverlap::heuristic(const Solution &solution, unsigned int iter) const
@@ -122,18 +147,28 @@ double opt::BoxingNeighborhoodGeometryOverlap::heuristic(const Solution &solutio
 
     //For every box
     double penalty = 0.0;
-    for (auto box = solution.cbegin(); box != solution.cend(); box++)
+    for (size_t box_i = 0; box_i < solution.size(); box_i++)
     {
+        const Box &box = solution.box(box_i);
+        const size_t size = box.size();
+        const unsigned short *x = box.x(), *y = box.y(), *width = box.width(), *height = box.height();
+
         //For every rectangle
-        for (auto rectangle = box->rectangles.cbegin(); rectangle != box->rectangles.cend(); rectangle++)
+        for (size_t i = 0; i < size; i++)
         {
-            const unsigned int rectangle_area = rectangle->rectangle->width * rectangle->rectangle->height;
+            const unsigned int rectangle_area = static_cast<unsigned int>(width[i]) * height[i];
+            const unsigned int x_end = x[i] + width[i];
+            const unsigned int y_end = y[i] + height[i];
 
             //For every next rectangle
-            for (auto next_rectangle = rectangle + 1; next_rectangle != box->rectangles.cend(); next_rectangle++)
+            for (size_t j = i + 1; j < size; j++)
             {
-                const unsigned int next_area = next_rectangle->rectangle->width * next_rectangle->rectangle->height;
-                const unsigned int overlaps = overlap_area(*rectangle, *next_rectangle);
+                const unsigned int next_area = static_cast<unsigned int>(width[j]) * height[j];
+                const unsigned int begin_x = std::max(x[i], x[j]);
+                const unsigned int begin_y = std::max(y[i], y[j]);
+                const unsigned int end_x = std::min(x_end, static_cast<unsigned int>(x[j] + width[j]));
+                const unsigned int end_y = std::min(y_end, static_cast<unsigned int>(y[j] + height[j]));
+                const unsigned int overlaps = (begin_x < end_x && begin_y < end_y) ? (end_x - begin_x) * (end_y - begin_y) : 0;
                 const double percentage = static_cast<double>(overlaps) / std::max(rectangle_area, next_area);
                 if (percentage > allowed_percentage) penalty += percentage_penalty * (percentage - allowed_percentage);
             }
@@ -169,7 +204,13 @@ bool opt::BoxingNeighborhoodGeometryOverlap::good(const Solution &solution, unsi
 }
 #endif
 
+bool opt::BoxingNeighborhoodGeometryOverlap::optimal(const Solution &solution, const Context &context) const
+{
+    //Rectangles may also stick out of boxes
+    return solution.size() <= _lower_bound && context.overlapping_number == 0 && !has_overlaps(solution);
+}
+
 std::vector<opt::Boxing::Box> opt::BoxingNeighborhoodGeometryOverlap::get_boxes(const Solution &solution) const
 {
-    return solution;
+    return solution.boxes();
 }
\ No newline at end of file
@@ -4,25 +4,76 @@
 #include <vector>
 
 opt::BoxingNeighborhoodOrder::BoxingNeighborhoodOrder(unsigned int box_size, unsigned int item_number, unsigned int item_size_min, unsigned int item_size_max,
-    unsigned int seed, unsigned int window)
-    : Boxing(box_size, item_number, item_size_min, item_size_max, seed), _window(window)
+    unsigned int seed, unsigned int window, size_t cache_size)
+    : Boxing(box_size, item_number, item_size_min, item_size_max, seed), _window(window), _cache(cache_size)
 {
 }
 
+unsigned long long opt::BoxingNeighborhoodOrder::_moment(const Rectangle &rectangle)
+{
+    const unsigned long long area = static_cast<unsigned long long>(rectangle.width) * rectangle.height;
+    return area * std::min(rectangle.width, rectangle.height);
+}
+
 opt::BoxingNeighborhoodOrder::Solution opt::BoxingNeighborhoodOrder::initial(unsigned int seed) const
 {
-    std::vector<const Rectangle*> order(_rectangles.size());
-    for (unsigned int i = 0; i < order.size(); i++) order[i] = &_rectangles[i];
+    std::vector<unsigned int> order(_rectangles.size());
+    for (unsigned int i = 0; i < order.size(); i++) order[i] = i;
     std::default_random_engine engine(seed);
     std::shuffle(order.begin(), order.end(), engine);
-    return order;
+    return Order(order);
 }
 
-opt::BoxingNeighborhoodOrder::SolutionContainer opt::BoxingNeighborhoodOrder::neighbors(const Solution &solution,
-    std::default_random_engine &engine, unsigned int id, unsigned int nthreads) const
+double opt::BoxingNeighborhoodOrder::prepare(const Solution &solution, unsigned int, Context *context) const
 {
-    std::vector<Solution> neighborhood;
+    //Pack, energy of every placed rectangle is summed as in energy()
+    context->box_number = 0;
+    context->rectangle_affinity.resize(solution.size());
+    context->items = solution.items();
+    context->placements.resize(solution.size());
+    context->prefix_energy.resize(solution.size() + 1);
+    context->prefix_energy[0] = 0;
+    for (unsigned int rectangle_i = 0; rectangle_i < solution.size(); rectangle_i++)
+    {
+        const unsigned int box_i = _put_rectangle(_rectangles[solution[rectangle_i]], &context->boxes, &context->box_number);
+        context->rectangle_affinity[rectangle_i] = box_i;
+        const BoxedRectangle placed = context->boxes[box_i].first[context->boxes[box_i].first.size() - 1];
+        context->placements[rectangle_i] = placed;
+        context->prefix_energy[rectangle_i + 1] = context->prefix_energy[rectangle_i];
+        _energy(&context->prefix_energy[rectangle_i + 1], &placed.x, &placed.y, &placed.width, &placed.height, 1, box_i, 1);
+    }
+
+    //Sum moments from the end
+    context->suffix_moment.resize(solution.size() + 1);
+    context->suffix_moment[solution.size()] = 0;
+    for (unsigned int rectangle_i = solution.size(); rectangle_i > 0; rectangle_i--)
+    {
+        context->suffix_moment[rectangle_i - 1] = context->suffix_moment[rectangle_i] + _moment(_rectangles[solution[rectangle_i - 1]]);
+    }
+
+    //Find empty boxes
+    const double empty_threshold = 0.4;
+    context->boxes_empty.resize(context->box_number);
+    for (unsigned int box_i = 0; box_i < context->box_number; box_i++)
+    {
+        const double percentage = static_cast<double>(occupied_area(context->boxes[box_i].first)) / (_box_size * _box_size - 1);
+        context->boxes_empty[box_i] = percentage <= empty_threshold;
+    }
+
+    //Packing gives heuristic
+    double value = 0;
+    for (unsigned int box_i = 0; box_i < context->box_number; box_i++)
+    {
+        const Box &box = context->boxes[box_i].first;
+        _energy(&value, box.x(), box.y(), box.width(), box.height(), box.size(), box_i, 1);
+    }
+    _cache.insert(solution.hash(), value);
+    return value;
+}
 
+void opt::BoxingNeighborhoodOrder::neighbors(const Solution &solution, const Context &context,
+    std::default_random_engine &engine, Neighbors<Solution> *neighborhood, unsigned int id, unsigned int nthreads) const
+{
     //Adding regular permutations
     const unsigned int begin_rectangle_i = solution.size() * id / nthreads;
     const unsigned int end_rectangle_i = solution.size() * (id + 1) / nthreads;
@@ -30,65 +81,125 @@ opt::BoxingNeighborhoodOrder::SolutionContainer opt::BoxingNeighborhoodOrder::ne
     {
         for (unsigned int new_rectangle_i = rectangle_i + 1; new_rectangle_i <= rectangle_i + _window && new_rectangle_i < solution.size(); new_rectangle_i++)
         {
-            neighborhood.push_back(solution);
-            neighborhood.back()[new_rectangle_i] = solution[rectangle_i];
-            neighborhood.back()[rectangle_i] = solution[new_rectangle_i];
+            //Swapping rectangles of one shape gives the same packing
+            if (_shape_classes[solution[rectangle_i]] == _shape_classes[solution[new_rectangle_i]])
+            {
+                OPTALG_COUNT(dropped, 1);
+                continue;
+            }
+            Solution &neighbor = neighborhood->push(solution);
+            OPTALG_COUNT(copied_bytes, memory_usage(solution));
+            neighbor.swap(rectangle_i, new_rectangle_i);
         }
     }
 
     //Randomly inserting rectangles from empty boxes
-    const double empty_threshold = 0.4;
-    std::vector<std::pair<Box, BoxImage>> boxes;
-    std::vector<unsigned int> rectangle_affinity(solution.size());
-    for (unsigned int rectangle_i = 0; rectangle_i < solution.size(); rectangle_i++)
+    std::uniform_int_distribution<unsigned int> distribution(0, solution.size());
+    for (unsigned int rectangle_i = begin_rectangle_i; rectangle_i < end_rectangle_i; rectangle_i++)
     {
-        const Rectangle &rectangle = *solution[rectangle_i];
-        rectangle_affinity[rectangle_i] = _put_rectangle(rectangle, &boxes);
+        if (context.boxes_empty[context.rectangle_affinity[rectangle_i]])
+        {
+            //Position past the end means the end
+            const unsigned int new_rectangle_i = std::min<unsigned int>(distribution(engine), solution.size() - 1);
+            Solution &neighbor = neighborhood->push(solution);
+            OPTALG_COUNT(copied_bytes, memory_usage(solution));
+            neighbor.move(rectangle_i, new_rectangle_i);
+        }
     }
+}
+
+double opt::BoxingNeighborhoodOrder::heuristic(const Solution &solution, unsigned int) const
+{
+    //Swaps of neighboring windows often lead back to evaluated orders
+    double value;
+    if (_cache.find(solution.hash(), &value)) return value;
+    std::vector<Box> boxes = get_boxes(solution);
+    value = energy(boxes);
+    _cache.insert(solution.hash(), value);
+    return value;
+}
+
+double opt::BoxingNeighborhoodOrder::heuristic(const Solution &neighbor, const Context &context, unsigned int, double threshold) const
+{
+    double value;
+    if (_cache.find(neighbor.hash(), &value)) return value;
 
-    std::vector<bool> boxes_empty(boxes.size());
-    for (unsigned int box_i = 0; box_i < boxes.size(); box_i++)
+    //Rectangles before the first changed position are placed as in the solution, without searching
+    size_t changed = 0;
+    while (changed < neighbor.size() && neighbor[changed] == context.items[changed]) changed++;
+    static thread_local std::vector<std::pair<Box, BoxImage>> boxes;
+    size_t box_number = 0;
+    for (size_t rectangle_i = 0; rectangle_i < changed; rectangle_i++)
     {
-        const double percentage = static_cast<double>(occupied_area(boxes[box_i].first)) / (_box_size * _box_size - 1);
-        boxes_empty[box_i] = percentage <= empty_threshold;
+        const unsigned int box_i = context.rectangle_affinity[rectangle_i];
+        if (box_i == box_number) _open_box(&boxes, &box_number);
+        boxes[box_i].first.push_back(context.placements[rectangle_i]);
+        _image_add(&boxes[box_i].second, context.placements[rectangle_i]);
     }
 
-    std::uniform_int_distribution<unsigned int> distribution(0, solution.size());
-    for (unsigned int rectangle_i = begin_rectangle_i; rectangle_i < end_rectangle_i; rectangle_i++)
+    //Other rectangles are packed until the energy is known or cannot be lower than threshold
+    value = context.prefix_energy[changed];
+    unsigned long long remaining_moment = context.suffix_moment[changed];
+    for (size_t rectangle_i = changed; rectangle_i < neighbor.size(); rectangle_i++)
     {
-        const unsigned int box_i = rectangle_affinity[rectangle_i];
-        const bool empty = boxes_empty[box_i];
-        if (empty)
+        const Rectangle &rectangle = _rectangles[neighbor[rectangle_i]];
+        const unsigned int box_i = _put_rectangle(rectangle, &boxes, &box_number);
+        const BoxedRectangle placed = boxes[box_i].first[boxes[box_i].first.size() - 1];
+        _energy(&value, &placed.x, &placed.y, &placed.width, &placed.height, 1, box_i, 1);
+
+        //Remaining rectangles contribute at least as if they lay in the first box at the bottom on their longer side
+        remaining_moment -= _moment(rectangle);
+        const double bound = value + static_cast<double>(remaining_moment) / 2;
+        if (bound >= threshold && rectangle_i + 1 < neighbor.size())
         {
-            const Rectangle *rectangle = solution[rectangle_i];
-            const unsigned int new_rectangle_i = distribution(engine);
-            neighborhood.push_back(solution);
-            neighborhood.back().erase(neighborhood.back().begin() + rectangle_i);
-            neighborhood.back().insert(neighborhood.back().begin() + new_rectangle_i, rectangle);
+            OPTALG_COUNT(pruned, 1);
+            return bound;
         }
     }
+    _cache.insert(neighbor.hash(), value);
+    return value;
+}
 
-    return neighborhood;
+bool opt::BoxingNeighborhoodOrder::good(const Solution &, unsigned int) const
+{
+    return true;
 }
 
-double opt::BoxingNeighborhoodOrder::heuristic(const Solution &solution, unsigned int) const
+bool opt::BoxingNeighborhoodOrder::optimal(const Solution &, const Context &context) const
 {
-    std::vector<Box> boxes = get_boxes(solution);
-    return energy(boxes);
+    return context.box_number <= _lower_bound;
 }
 
-bool opt::BoxingNeighborhoodOrder::good(const Solution &, unsigned int) const
+opt::BoxingNeighborhoodOrder::Solution opt::BoxingNeighborhoodOrder::crossover(const Solution &first, const Solution &second,
+    std::default_random_engine &engine) const
 {
-    return true;
+    if (first.size() < 2) return first;
+    std::uniform_int_distribution<size_t> distribution(1, first.size() - 1);
+    const size_t cut = distribution(engine);
+    std::vector<unsigned int> items(first.items().cbegin(), first.items().cbegin() + cut);
+    std::vector<bool> taken(first.size(), false);
+    for (auto item = items.cbegin(); item != items.cend(); item++) taken[*item] = true;
+    for (auto item = second.items().cbegin(); item != second.items().cend(); item++) if (!taken[*item]) items.push_back(*item);
+    return Order(items);
+}
+
+void opt::BoxingNeighborhoodOrder::mutate(Solution *solution, std::default_random_engine &engine) const
+{
+    //Swap as in neighbors() or move a rectangle anywhere
+    if (solution->size() < 2) return;
+    std::uniform_int_distribution<size_t> distribution(0, solution->size() - 1);
+    const size_t i = distribution(engine), j = distribution(engine);
+    if (std::bernoulli_distribution(0.5)(engine)) solution->swap(i, j);
+    else solution->move(i, j);
 }
 
 std::vector<opt::Boxing::Box> opt::BoxingNeighborhoodOrder::get_boxes(const Solution &solution) const
 {
     //Build
     std::vector<std::pair<Box, BoxImage>> boxes;
-    for (auto rectangle = solution.cbegin(); rectangle != solution.cend(); rectangle++)
+    for (auto rectangle = solution.items().cbegin(); rectangle != solution.items().cend(); rectangle++)
     {
-        _put_rectangle(**rectangle, &boxes);
+        _put_rectangle(_rectangles[*rectangle], &boxes);
     }
 
     //Extract boxes
@@ -1,36 +1,66 @@
 #include "../include/optalg/greedy.hpp"
 #include "../include/optalg/neighborhood.hpp"
+#include "../include/optalg/branch_and_bound.hpp"
+#include "../include/optalg/genetic.hpp"
+#include "../include/optalg/large_neighborhood.hpp"
 #include "../include/optalg/boxing_greedy.h"
+#include "../include/optalg/boxing_branch_and_bound.h"
+#include "../include/optalg/boxing_large_neighborhood.h"
 #include "../include/optalg/boxing_neighborhood.h"
+#include "../include/optalg/stats.h"
+#include "../include/optalg/trace.h"
+#include "../include/optalg/arguments.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <fstream>
 #include <iomanip>
 #include <iostream>
 #include <limits>
 #include <memory>
+#include <mutex>
+#include <sstream>
 #include <stdexcept>
 #include <string>
+#include <thread>
+#include <vector>
+#include <new>
+#include <stdlib.h>
 #include <string.h>
 
-bool parse_bool(const char *s)
+#ifdef OPTALG_STATS
+//Heap allocations of all threads are counted for --stats
+void *operator new(size_t size)
 {
-    if (strcmp(s, "true") == 0) return true;
-    else if (strcmp(s, "false") == 0) return false;
-    else throw std::runtime_error("Invalid boolean value");
+    OPTALG_COUNT(allocations, 1);
+    void *pointer = malloc((size != 0) ? size : 1);
+    if (pointer == nullptr) throw std::bad_alloc();
+    return pointer;
 }
 
-unsigned int parse_uint(const char *s)
+//Not inlined, GCC would take inlined free() for a mismatch with the allocation
+#ifdef __GNUC__
+    #define OPTALG_NOINLINE __attribute__((noinline))
+#else
+    #define OPTALG_NOINLINE
+#endif
+
+OPTALG_NOINLINE void operator delete(void *pointer) noexcept
 {
-    char *end;
-    unsigned int result = strtoul(s, &end, 10);
-    if (*end != '\0') throw std::runtime_error("Invalid integer value");
-    return result;
+    free(pointer);
 }
 
-double parse_double(const char *s)
+OPTALG_NOINLINE void operator delete(void *pointer, size_t) noexcept
 {
-    char *end;
-    double result = strtod(s, &end);
-    if (*end != '\0') throw std::runtime_error("Invalid double value");
-    return result;
+    free(pointer);
+}
+#endif
+
+const char *metric_name(opt::BoxingGreedy::Metric metric)
+{
+    if (metric == opt::BoxingGreedy::Metric::area) return "area";
+    else if (metric == opt::BoxingGreedy::Metric::max_size) return "max_size";
+    else return "min_size";
 }
 
 opt::BoxingGreedy::Metric parse_metric(const char *s)
@@ -43,7 +73,8 @@ opt::BoxingGreedy::Metric parse_metric(const char *s)
 
 std::string parse_method(const char *s)
 {
-    if (strcmp(s, "greedy") != 0 && strcmp(s, "neighborhood") != 0)
+    if (strcmp(s, "greedy") != 0 && strcmp(s, "neighborhood") != 0 && strcmp(s, "branch_and_bound") != 0
+        && strcmp(s, "genetic") != 0 && strcmp(s, "large_neighborhood") != 0)
         throw std::runtime_error("Invalid method value");
     else return s;
 }
@@ -55,13 +86,15 @@ std::string parse_neighborhood(const char *s)
     else return s;
 }
 
-int _main(int argc, char **argv)
+struct Job
 {
     //Mode
     std::string method = "greedy";
     opt::BoxingGreedy::Metric metric = opt::BoxingGreedy::Metric::area;
     std::string neighborhood = "geometry";
     unsigned int loglevel = 1;
+    bool stats = false;
+    std::string trace;
 
     //Problem
     unsigned int box_size = 10;
@@ -72,118 +105,412 @@ int _main(int argc, char **argv)
     unsigned int window = 1;
     unsigned int hwindow = 0;
     unsigned int desired_iter = 100;
+    unsigned int focus = 0;
+    bool slide = false;
+    unsigned int cache_size = opt::HeuristicCache::default_size;
+    unsigned int population = 50;
+    unsigned int archive = 5;
+    double mutation = 0.2;
+    unsigned int ruin_boxes = 2;
+    unsigned int ruin_nearby = 10;
+    unsigned int orderings = 8;
 
     //Solution
     unsigned int iter_max = std::numeric_limits<unsigned int>::max();
+    unsigned int stall_max = 50;
     double time_max = std::numeric_limits<double>::infinity();
     bool return_good = true;
-    
-    //Parse
-    for (int i = 1;;)
-    {
-        if (i == argc) break;
-        else if (i == argc - 1) throw std::runtime_error("Argument missing value");
-        const char *argument = argv[i];
-        const char *value = argv[i + 1];
-        if (strcmp(argument, "--method") == 0) method = parse_method(value);
-        else if (strcmp(argument, "--metric") == 0) metric = parse_metric(value);
-        else if (strcmp(argument, "--neighborhood") == 0) neighborhood = parse_neighborhood(value);
-        else if (strcmp(argument, "--loglevel") == 0) loglevel = parse_uint(value);
-
-        else if (strcmp(argument, "--box_size") == 0) box_size = parse_uint(value);
-        else if (strcmp(argument, "--item_number") == 0) item_number = parse_uint(value);
-        else if (strcmp(argument, "--item_size_min") == 0) item_size_min = parse_uint(value);
-        else if (strcmp(argument, "--item_size_max") == 0) item_size_max = parse_uint(value);
-        else if (strcmp(argument, "--seed") == 0) seed = parse_uint(value);
-        else if (strcmp(argument, "--window") == 0) window = parse_uint(value);
-        else if (strcmp(argument, "--hwindow") == 0) hwindow = parse_uint(value);
-        else if (strcmp(argument, "--desired_iter") == 0) desired_iter = parse_uint(value);
-        
-        else if (strcmp(argument, "--iter_max") == 0) iter_max = parse_uint(value);
-        else if (strcmp(argument, "--time_max") == 0) time_max = parse_double(value);
-        else if (strcmp(argument, "--return_good") == 0) return_good = parse_bool(value);
-        else throw std::runtime_error("Invalid argument name");
-        i += 2;
-    }
+    double memory_max = 0;
+};
 
-    //Call
+struct Batch
+{
+    std::string path;
+    unsigned int jobs = 0;
+    unsigned int threads = 0;
+};
+
+struct Result
+{
     std::unique_ptr<opt::Boxing> boxing;
     std::vector<opt::Boxing::Box> boxes;
     unsigned int iteration_count;
+    unsigned int bound = 0;     //Proven lower bound of box number
     double timer;
-    if (method == "greedy")
+    double wall;
+    std::vector<opt::Stats> iteration_stats;
+    opt::Stats stats;
+};
+
+bool parse_argument(Job *job, const char *argument, const char *value)
+{
+    if (strcmp(argument, "--method") == 0) job->method = parse_method(value);
+    else if (strcmp(argument, "--metric") == 0) job->metric = parse_metric(value);
+    else if (strcmp(argument, "--neighborhood") == 0) job->neighborhood = parse_neighborhood(value);
+    else if (strcmp(argument, "--loglevel") == 0) job->loglevel = opt::parse_uint(value);
+    else if (strcmp(argument, "--stats") == 0) job->stats = opt::parse_bool(value);
+    else if (strcmp(argument, "--trace") == 0) job->trace = value;
+
+    else if (strcmp(argument, "--box_size") == 0) job->box_size = opt::parse_uint(value);
+    else if (strcmp(argument, "--item_number") == 0) job->item_number = opt::parse_uint(value);
+    else if (strcmp(argument, "--item_size_min") == 0) job->item_size_min = opt::parse_uint(value);
+    else if (strcmp(argument, "--item_size_max") == 0) job->item_size_max = opt::parse_uint(value);
+    else if (strcmp(argument, "--seed") == 0) job->seed = opt::parse_uint(value);
+    else if (strcmp(argument, "--window") == 0) job->window = opt::parse_uint(value);
+    else if (strcmp(argument, "--hwindow") == 0) job->hwindow = opt::parse_uint(value);
+    else if (strcmp(argument, "--desired_iter") == 0) job->desired_iter = opt::parse_uint(value);
+    else if (strcmp(argument, "--focus") == 0) job->focus = opt::parse_uint(value);
+    else if (strcmp(argument, "--slide") == 0) job->slide = opt::parse_bool(value);
+    else if (strcmp(argument, "--cache_size") == 0) job->cache_size = opt::parse_uint(value);
+    else if (strcmp(argument, "--population") == 0) job->population = opt::parse_uint(value);
+    else if (strcmp(argument, "--archive") == 0) job->archive = opt::parse_uint(value);
+    else if (strcmp(argument, "--mutation") == 0) job->mutation = opt::parse_double(value);
+    else if (strcmp(argument, "--ruin_boxes") == 0) job->ruin_boxes = opt::parse_uint(value);
+    else if (strcmp(argument, "--ruin_nearby") == 0) job->ruin_nearby = opt::parse_uint(value);
+    else if (strcmp(argument, "--orderings") == 0) job->orderings = opt::parse_uint(value);
+
+    else if (strcmp(argument, "--iter_max") == 0) job->iter_max = opt::parse_uint(value);
+    else if (strcmp(argument, "--stall_max") == 0) job->stall_max = opt::parse_uint(value);
+    else if (strcmp(argument, "--time_max") == 0) job->time_max = opt::parse_double(value);
+    else if (strcmp(argument, "--return_good") == 0) job->return_good = opt::parse_bool(value);
+    else if (strcmp(argument, "--memory_max") == 0) job->memory_max = opt::parse_double(value);
+    else return false;
+    return true;
+}
+
+Result run(const Job &job, unsigned int nthreads)
+{
+    const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    const opt::Stats outer_stats = opt::thread_stats();
+    opt::thread_stats() = opt::Stats();
+    std::unique_ptr<opt::Trace> trace(job.trace.empty() ? nullptr : new opt::Trace());
+    Result result;
+    if (job.method == "greedy")
     {
         typedef opt::BoxingGreedy Problem;
-        Problem *problem = new Problem(box_size, item_number, item_size_min, item_size_max, seed, metric);
-        boxing.reset(problem);
+        Problem *problem = new Problem(job.box_size, job.item_number, job.item_size_min, job.item_size_max, job.seed, job.metric);
+        result.boxing.reset(problem);
         std::vector<Problem::Solution> log;
-        Problem::Solution solution = opt::greedy(*problem, &log, &timer);
-        boxes = problem->get_boxes(solution);
-        iteration_count = log.size() - 1;
+        Problem::Solution solution = opt::greedy(*problem, &log, &result.timer, trace.get());
+        result.boxes = problem->get_boxes(solution);
+        result.iteration_count = log.size() - 1;
     }
-    else if (neighborhood == "geometry")
+    else if (job.method == "branch_and_bound")
+    {
+        typedef opt::BoxingBranchAndBound Problem;
+        Problem *problem = new Problem(job.box_size, job.item_number, job.item_size_min, job.item_size_max, job.seed);
+        result.boxing.reset(problem);
+        double bound;
+        unsigned long long nodes;
+        Problem::Node node = opt::branch_and_bound(*problem, job.time_max, &bound, &result.timer, nthreads, &nodes, trace.get());
+        if (!problem->complete(node)) throw std::runtime_error("No solution found in time");
+        result.boxes = problem->get_boxes(node);
+        result.iteration_count = static_cast<unsigned int>(std::min<unsigned long long>(nodes, std::numeric_limits<unsigned int>::max()));
+        result.bound = static_cast<unsigned int>(bound);
+    }
+    else if (job.method == "genetic")
+    {
+        typedef opt::BoxingNeighborhoodOrder Problem;
+        Problem *problem = new Problem(job.box_size, job.item_number, job.item_size_min, job.item_size_max, job.seed, job.window, job.cache_size);
+        result.boxing.reset(problem);
+        std::vector<Problem::Solution> log;
+        Problem::Solution solution = opt::genetic(*problem, job.population, job.archive, job.mutation, job.iter_max, job.stall_max, job.time_max,
+            &log, &result.timer, nthreads, &result.iteration_stats, trace.get());
+        result.boxes = problem->get_boxes(solution);
+        result.iteration_count = log.size() - 1;
+    }
+    else if (job.method == "large_neighborhood")
+    {
+        typedef opt::BoxingLargeNeighborhood Problem;
+        Problem *problem = new Problem(job.box_size, job.item_number, job.item_size_min, job.item_size_max, job.seed, job.ruin_boxes, job.ruin_nearby);
+        result.boxing.reset(problem);
+        std::vector<Problem::Solution> log;
+        Problem::Solution solution = opt::large_neighborhood(*problem, job.orderings, job.iter_max, job.stall_max, job.time_max,
+            &log, &result.timer, nthreads, &result.iteration_stats, trace.get());
+        result.boxes = problem->get_boxes(solution);
+        result.iteration_count = log.size() - 1;
+    }
+    else if (job.neighborhood == "geometry")
     {
         typedef opt::BoxingNeighborhoodGeometry Problem;
-        Problem *problem = new Problem(box_size, item_number, item_size_min, item_size_max, seed, window, hwindow);
-        boxing.reset(problem);
+        Problem *problem = new Problem(job.box_size, job.item_number, job.item_size_min, job.item_size_max, job.seed, job.window, job.hwindow, job.cache_size, job.slide);
+        result.boxing.reset(problem);
         std::vector<Problem::Solution> log;
-        Problem::Solution solution = opt::neighborhood(*problem, iter_max, time_max, return_good, &log, &timer);
-        boxes = problem->get_boxes(solution);
-        iteration_count = log.size() - 1;
+        Problem::Solution solution = opt::neighborhood(*problem, job.iter_max, job.time_max, job.return_good, &log, &result.timer, nthreads, &result.iteration_stats, trace.get(),
+            static_cast<size_t>(job.memory_max * 1024 * 1024));
+        result.boxes = problem->get_boxes(solution);
+        result.iteration_count = log.size() - 1;
     }
-    else if (neighborhood == "order")
+    else if (job.neighborhood == "order")
     {
         typedef opt::BoxingNeighborhoodOrder Problem;
-        Problem *problem = new Problem(box_size, item_number, item_size_min, item_size_max, seed, window);
-        boxing.reset(problem);
+        Problem *problem = new Problem(job.box_size, job.item_number, job.item_size_min, job.item_size_max, job.seed, job.window, job.cache_size);
+        result.boxing.reset(problem);
         std::vector<Problem::Solution> log;
-        Problem::Solution solution = opt::neighborhood(*problem, iter_max, time_max, return_good, &log, &timer);
-        boxes = problem->get_boxes(solution);
-        iteration_count = log.size() - 1;
+        Problem::Solution solution = opt::neighborhood(*problem, job.iter_max, job.time_max, job.return_good, &log, &result.timer, nthreads, &result.iteration_stats, trace.get(),
+            static_cast<size_t>(job.memory_max * 1024 * 1024));
+        result.boxes = problem->get_boxes(solution);
+        result.iteration_count = log.size() - 1;
     }
     else
     {
         typedef opt::BoxingNeighborhoodGeometryOverlap Problem;
-        Problem *problem = new Problem(box_size, item_number, item_size_min, item_size_max, seed, window, hwindow, desired_iter);
-        boxing.reset(problem);
+        Problem *problem = new Problem(job.box_size, job.item_number, job.item_size_min, job.item_size_max, job.seed, job.window, job.hwindow, job.desired_iter, job.focus);
+        result.boxing.reset(problem);
         std::vector<Problem::Solution> log;
-        Problem::Solution solution = opt::neighborhood(*problem, iter_max, time_max, return_good, &log, &timer);
-        boxes = problem->get_boxes(solution);
-        iteration_count = log.size() - 1;
+        Problem::Solution solution = opt::neighborhood(*problem, job.iter_max, job.time_max, job.return_good, &log, &result.timer, nthreads, &result.iteration_stats, trace.get(),
+            static_cast<size_t>(job.memory_max * 1024 * 1024));
+        result.boxes = problem->get_boxes(solution);
+        result.iteration_count = log.size() - 1;
+    }
+    result.wall = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    result.bound = std::max(result.bound, result.boxing->lower_bound());
+    result.stats = opt::thread_stats();
+    opt::thread_stats() = outer_stats;
+
+    //Save trace
+    if (trace != nullptr)
+    {
+        std::ofstream file(job.trace);
+        if (!file.is_open()) throw std::runtime_error("Cannot open trace file");
+        trace->write(file);
     }
 
     //Log level 0
-    if (boxing->has_overlaps(boxes)) throw std::logic_error("Check failed");
+    if (result.boxing->has_overlaps(result.boxes)) throw std::logic_error("Check failed");
+    return result;
+}
+
+void print_stats(const std::string &name, const opt::Stats &stats)
+{
+    std::cout << name << ": "
+        << stats.neighbors << " neighbors, "
+        << stats.dropped << " dropped, "
+        << stats.heuristics << " heuristics, "
+        << stats.pruned << " pruned, "
+        << stats.nodes << " nodes, "
+        << stats.probes << " probes, "
+        << stats.probe_cells << " probed cells, "
+        << stats.image_cells << " written cells, "
+        << stats.searches << " searches, "
+        << stats.placements << " placements, "
+        << std::setprecision(5) << stats.copied_bytes / (1024.0 * 1024.0) << "MiB copied, "
+        << std::setprecision(5) << stats.neighbor_memory_peak / (1024.0 * 1024.0) << "MiB neighbors peak, "
+        << stats.allocations << " allocations, "
+        << stats.cache_lookups << " cache lookups, "
+        << std::setprecision(4) << ((stats.cache_lookups != 0) ? (100.0 * stats.cache_hits / stats.cache_lookups) : 0.0) << "% cache hits" << std::endl;
+}
+
+void print(const Job &job, const Result &result)
+{
+    const opt::Boxing &boxing = *result.boxing;
+    const std::vector<opt::Boxing::Box> &boxes = result.boxes;
 
     //Log level 1
-    if (loglevel >= 1)
+    if (job.loglevel >= 1)
     {
-        std::cout << "Time      : " << std::setprecision(5) << timer << "s" << std::endl;
+        std::cout << "Time      : " << std::setprecision(5) << result.timer << "s" << std::endl;
         std::cout << "Boxes     : " << boxes.size() << std::endl;
-        std::cout << "Iterations: " << iteration_count << std::endl;
+        std::cout << "Iterations: " << result.iteration_count << std::endl;
+        std::cout << "Bound     : " << result.bound << std::endl;
+        std::cout << "Gap       : " << boxes.size() - result.bound << " boxes";
+        if (result.bound != 0) std::cout << " (" << std::setprecision(5) << 100.0 * (boxes.size() - result.bound) / result.bound << "%)";
+        std::cout << std::endl;
         std::cout << "Occupation: " << std::setprecision(5) <<
-            100.0 * boxing->occupied_area(boxes) / (boxes.size() * boxing->box_area()) << "%" << std::endl;
+            100.0 * boxing.occupied_area(boxes) / (boxes.size() * boxing.box_area()) << "%" << std::endl;
+    }
+
+    //Statistics
+    if (job.stats)
+    {
+        #ifdef OPTALG_STATS
+            for (unsigned int i = 0; i < result.iteration_stats.size(); i++) print_stats("Iteration " + std::to_string(i), result.iteration_stats[i]);
+            print_stats("Total", result.stats);
+        #else
+            std::cout << "Statistics: disabled, configure with -DSTATS=1" << std::endl;
+        #endif
     }
 
     //Log level 2
-    if (loglevel >= 2) for (unsigned int i = 0; i < boxes.size(); i++)
+    if (job.loglevel >= 2) for (unsigned int i = 0; i < boxes.size(); i++)
     {
         std::cout << "Box " << i << ": " <<
-            boxes[i].rectangles.size() << " rectangles, " <<
-            std::setprecision(5) << 100.0 * boxing->occupied_area(boxes[i]) / boxing->box_area() << "% occupied" << std::endl;
+            boxes[i].size() << " rectangles, " <<
+            std::setprecision(5) << 100.0 * boxing.occupied_area(boxes[i]) / boxing.box_area() << "% occupied" << std::endl;
 
         //Log level 3
-        if (loglevel >= 3) for (unsigned int j = 0; j < boxes[i].rectangles.size(); j++)
+        if (job.loglevel >= 3) for (unsigned int j = 0; j < boxes[i].size(); j++)
         {
-            const opt::Boxing::BoxedRectangle &r = boxes[i].rectangles[j];
+            const opt::Boxing::BoxedRectangle r = boxes[i][j];
             std::cout << "Rectangle " << j << ": ";
-            if (r.transposed)
-                std::cout << "[" << r.rectangle->height << ", " << r.rectangle->width << "] ";
-            else
-                std::cout << "[" << r.rectangle->width << ", " << r.rectangle->height << "] ";
+            std::cout << "[" << r.width << ", " << r.height << "] ";
             std::cout << "(" << r.x << ", " << r.y << ") " << std::endl;
         }
     }
+}
+
+std::string format_batch(unsigned int index, const Job &job, const Result &result)
+{
+    std::ostringstream stream;
+    stream << std::setprecision(6);
+    stream << "{\"job\":" << index << ",\"method\":\"" << job.method << "\",";
+    if (job.method == "greedy") stream << "\"metric\":\"" << metric_name(job.metric) << "\",";
+    else if (job.method == "genetic") stream << "\"population\":" << job.population << ",";
+    else if (job.method == "large_neighborhood") stream << "\"ruin_boxes\":" << job.ruin_boxes << ",";
+    else if (job.method == "neighborhood") stream << "\"neighborhood\":\"" << job.neighborhood << "\",";
+    stream << "\"box_size\":" << job.box_size << ",\"item_number\":" << job.item_number
+        << ",\"item_size_min\":" << job.item_size_min << ",\"item_size_max\":" << job.item_size_max
+        << ",\"seed\":" << job.seed
+        << ",\"wall\":" << result.wall << ",\"boxes\":" << result.boxes.size() << ",\"iterations\":" << result.iteration_count
+        << ",\"occupation\":" << 100.0 * result.boxing->occupied_area(result.boxes) / (result.boxes.size() * result.boxing->box_area())
+        << ",\"bound\":" << result.bound << ",\"gap\":" << result.boxes.size() - result.bound;
+
+    //Total counters, null if statistics are disabled
+    if (job.stats)
+    {
+        #ifdef OPTALG_STATS
+            const opt::Stats &stats = result.stats;
+            stream << ",\"stats\":{\"neighbors\":" << stats.neighbors << ",\"dropped\":" << stats.dropped
+                << ",\"heuristics\":" << stats.heuristics << ",\"pruned\":" << stats.pruned << ",\"nodes\":" << stats.nodes
+                << ",\"probes\":" << stats.probes << ",\"probe_cells\":" << stats.probe_cells << ",\"image_cells\":" << stats.image_cells
+                << ",\"searches\":" << stats.searches << ",\"placements\":" << stats.placements << ",\"copied_bytes\":" << stats.copied_bytes
+                << ",\"neighbor_memory_peak\":" << stats.neighbor_memory_peak << ",\"allocations\":" << stats.allocations
+                << ",\"cache_lookups\":" << stats.cache_lookups << ",\"cache_hits\":" << stats.cache_hits << "}";
+        #else
+            stream << ",\"stats\":null";
+        #endif
+    }
+    stream << "}";
+    return stream.str();
+}
+
+std::string format_batch_error(unsigned int index, const std::string &what)
+{
+    std::ostringstream stream;
+    stream << "{\"job\":" << index << ",\"error\":\"";
+    for (auto c = what.cbegin(); c != what.cend(); c++)
+    {
+        if (*c == '"' || *c == '\\') stream << '\\';
+        stream << *c;
+    }
+    stream << "\"}";
+    return stream.str();
+}
+
+//Path with index inserted before extension of file name, so that jobs do not overwrite files of each other
+std::string indexed_path(const std::string &path, unsigned int index)
+{
+    const size_t slash = path.find_last_of("/\\");
+    const size_t dot = path.find_last_of('.');
+    const size_t end = (dot != std::string::npos && (slash == std::string::npos || dot > slash + 1)) ? dot : path.size();
+    return path.substr(0, end) + "." + std::to_string(index) + path.substr(end);
+}
+
+std::vector<Job> read_batch(const std::string &path, const Job &defaults)
+{
+    std::ifstream file(path);
+    if (!file.is_open()) throw std::runtime_error("Cannot open batch file");
+    std::vector<Job> jobs;
+    std::string line;
+    for (unsigned int line_number = 1; std::getline(file, line); line_number++)
+    {
+        //Skip comments and empty lines
+        const size_t comment = line.find('#');
+        if (comment != std::string::npos) line.erase(comment);
+        std::istringstream stream(line);
+        std::vector<std::string> tokens;
+        std::string token;
+        while (stream >> token) tokens.push_back(token);
+        if (tokens.empty()) continue;
+
+        //Parse job on top of command line arguments
+        Job job = defaults;
+        try
+        {
+            if (tokens.size() % 2 != 0) throw std::runtime_error("Argument missing value");
+            for (unsigned int i = 0; i < tokens.size(); i += 2)
+            {
+                if (!parse_argument(&job, tokens[i].c_str(), tokens[i + 1].c_str())) throw std::runtime_error("Invalid argument name");
+            }
+        }
+        catch (const std::exception &e)
+        {
+            throw std::runtime_error(std::string(e.what()) + " in batch file line " + std::to_string(line_number));
+        }
+        jobs.push_back(job);
+    }
+    return jobs;
+}
+
+void run_batch(const Batch &batch, const Job &defaults)
+{
+    std::vector<Job> jobs = read_batch(batch.path, defaults);
+    if (jobs.empty()) return;
+
+    //Balance job-level and solver-level parallelism: run as many jobs as there are cores, give leftover cores to the solvers
+    const unsigned int hardware = std::max(std::thread::hardware_concurrency(), 1u);
+    const unsigned int nworkers = std::min(static_cast<unsigned int>(jobs.size()), (batch.jobs != 0) ? batch.jobs : hardware);
+    const unsigned int nthreads = (batch.threads != 0) ? batch.threads : std::max(hardware / nworkers, 1u);
+
+    //Jobs run concurrently, so every one gets its share of the memory limit
+    for (auto job = jobs.begin(); job != jobs.end(); job++) job->memory_max /= nworkers;
+
+    //Every job saves its own trace
+    for (unsigned int index = 0; index < jobs.size(); index++)
+    {
+        if (!jobs[index].trace.empty()) jobs[index].trace = indexed_path(jobs[index].trace, index);
+    }
+
+    //Run jobs on worker pool
+    std::atomic<unsigned int> next(0);
+    std::mutex output_mutex;
+    std::vector<std::thread> workers;
+    for (unsigned int worker = 0; worker < nworkers; worker++)
+    {
+        workers.push_back(std::thread([&jobs, &next, &output_mutex, nthreads]()
+        {
+            for (unsigned int index = next++; index < jobs.size(); index = next++)
+            {
+                std::string line;
+                try
+                {
+                    line = format_batch(index, jobs[index], run(jobs[index], nthreads));
+                }
+                catch (const std::exception &e)
+                {
+                    line = format_batch_error(index, e.what());
+                }
+                std::lock_guard<std::mutex> lock(output_mutex);
+                std::cout << line << std::endl;
+            }
+        }));
+    }
+    for (auto worker = workers.begin(); worker != workers.end(); worker++) worker->join();
+}
+
+int _main(int argc, char **argv)
+{
+    Job job;
+    Batch batch;
+    
+    //Parse
+    for (int i = 1;;)
+    {
+        if (i == argc) break;
+        else if (i == argc - 1) throw std::runtime_error("Argument missing value");
+        const char *argument = argv[i];
+        const char *value = argv[i + 1];
+        if (parse_argument(&job, argument, value)) {}
+        else if (strcmp(argument, "--batch") == 0) batch.path = value;
+        else if (strcmp(argument, "--jobs") == 0) batch.jobs = opt::parse_uint(value);
+        else if (strcmp(argument, "--threads") == 0) batch.threads = opt::parse_uint(value);
+        else throw std::runtime_error("Invalid argument name");
+        i += 2;
+    }
+
+    //Call
+    if (!batch.path.empty()) run_batch(batch, job);
+    else print(job, run(job, batch.threads));
     return 0;
 }
 
@@ -12,13 +12,22 @@
 #include <wx/panel.h>
 #include <wx/scrolbar.h>
 #include <wx/display.h>
+#include <wx/dcbuffer.h>
+#include <wx/dcmemory.h>
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
 #include <cmath>
 #include <exception>
 #include <limits>
+#include <list>
 #include <stdexcept>
 #include <string>
 #include <memory>
+#include <thread>
+#include <unordered_map>
+#include <vector>
 
 namespace opt
 {
@@ -31,6 +40,89 @@ namespace opt
     const wxString mode_strings[] = { "Greedy (area)", "Greedy (largest side)", "Greedy (smallest side)",
     "Local search (geometry)", "Local search (order)", "Local search (geometry/overlaps)" };
 
+    ///Parameters read from the frame, the solver thread creates the problem from them
+    struct Settings
+    {
+        Mode mode;
+        unsigned int box_size, item_number, item_size_min, item_size_max, seed;
+        unsigned int window, hwindow, desired_iter;
+        unsigned int iter_max;
+        double time_max;
+        bool return_good;
+    };
+
+    ///Latest solution of a running algorithm, sent by the solver thread
+    struct Progress
+    {
+        unsigned int iteration;
+        double heuristic;   //Not a number for greedy algorithms
+        double elapsed;     //Wall time, seconds
+        std::vector<Boxing::Box> boxes;
+    };
+
+    ///Log of a finished algorithm, solutions are turned into boxes only when shown and the recently shown ones are kept
+    class Log
+    {
+    private:
+        static constexpr size_t _recent_max = 16;
+        typedef std::list<std::pair<size_t, std::vector<Boxing::Box>>> Recent;
+        Recent _recent;                                                 //Boxes of recently shown iterations, most recent first
+        std::unordered_map<size_t, Recent::iterator> _recent_index;     //Position of every iteration in _recent
+        std::vector<std::vector<unsigned int>> _changes;                //Rectangles changed by every step, sorted
+        std::vector<bool> _changes_found;                               //Changes are found once, when first shown
+
+    protected:
+        virtual std::vector<Boxing::Box> _get_boxes(size_t iteration) const = 0;
+        virtual std::vector<unsigned int> _find_changes(size_t iteration);  //Compares boxes of iteration and next one
+        static std::vector<unsigned int> _get_changes(const std::vector<Boxing::Box> &a, const std::vector<Boxing::Box> &b);
+        static std::vector<unsigned int> _get_changes(const BoxingNeighborhoodOrder::Solution &a, const BoxingNeighborhoodOrder::Solution &b);
+
+    public:
+        virtual ~Log() = default;
+        virtual size_t size() const = 0;
+        const std::vector<Boxing::Box> &boxes(size_t iteration);
+        const std::vector<unsigned int> &changes(size_t iteration);     //Rectangles changed between iteration and next one, sorted
+    };
+
+    ///Log of solutions of a problem, which is not owned
+    template <class Problem> class ProblemLog : public Log
+    {
+    protected:
+        const Problem *_problem;
+        std::vector<typename Problem::Solution> _solutions;
+        std::vector<Boxing::Box> _get_boxes(size_t iteration) const override;
+
+    public:
+        ProblemLog(const Problem *problem, std::vector<typename Problem::Solution> &&solutions);
+        size_t size() const override;
+    };
+
+    ///Log of order neighborhood, changes are found from orders without packing them
+    class OrderLog : public ProblemLog<BoxingNeighborhoodOrder>
+    {
+    protected:
+        std::vector<unsigned int> _find_changes(size_t iteration) override;
+
+    public:
+        using ProblemLog<BoxingNeighborhoodOrder>::ProblemLog;
+    };
+
+    ///Log of a finished algorithm, sent by the solver thread
+    struct Result
+    {
+        std::unique_ptr<Boxing> boxing;     //Problem created by the solver thread
+        std::shared_ptr<Log> log;           //Refers to boxing
+        double timer = 0.0;
+        std::string error;  //Empty if the algorithm succeeded
+    };
+
+    ///Box drawn to a bitmap, drawn again only if its rectangles, their colors or its size change
+    struct BoxBitmap
+    {
+        std::vector<unsigned int> key;  //Size, then position, size and color of every rectangle
+        wxBitmap bitmap;
+    };
+
     class Frame : public wxFrame
     {
     private:
@@ -54,6 +146,7 @@ namespace opt
 
         //Technical
         wxButton *_button_run = nullptr;
+        wxButton *_button_cancel = nullptr;
         wxButton *_button_next = nullptr;
         wxButton *_button_previous = nullptr;
         wxPanel *_panel_display = nullptr;
@@ -63,21 +156,41 @@ namespace opt
 
         //Logic
         Mode _mode;                                                 //Operating mode
-        std::unique_ptr<opt::Boxing> _boxing;                       //Boxing problem
-        std::vector<std::vector<Boxing::Box>> _log;                 //Log transformed to boxes
-        std::vector<BoxingNeighborhoodOrder::Solution> _log_order;  //Log specific to order neighborhood
+        std::unique_ptr<opt::Boxing> _boxing;                       //Boxing problem of finished algorithm
+        std::shared_ptr<Log> _log;                                  //Log of finished algorithm, refers to _boxing
+        unsigned int _box_size = 1;                                 //Box size of shown solutions, known before the problem is created
+        std::vector<Boxing::Box> _live;                             //Latest solution of running algorithm
         unsigned int _iteration;                                    //Current iteration
 
+        //Drawing
+        static constexpr unsigned int _no_iteration = std::numeric_limits<unsigned int>::max();
+        std::vector<BoxBitmap> _box_bitmaps;                        //Bitmap of every box of the current iteration
+        unsigned int _changes_iteration = _no_iteration;            //Iteration of changes
+        std::vector<unsigned int> _yellow, _blue;                   //Rectangles changed to and from the iteration, sorted
+
+        //Solving
+        static constexpr int _id_progress = wxID_HIGHEST + 1;       //Thread event carrying Progress
+        static constexpr int _id_result = wxID_HIGHEST + 2;         //Thread event carrying Result
+        std::thread _solver;                                        //Creates the problem and runs the algorithm
+        std::atomic<bool> _cancel{ false };                         //Stops the algorithm cooperatively
+        std::chrono::steady_clock::time_point _start;               //Start of the algorithm
+
         //Functions
         static unsigned int _parse_uint(const wxTextCtrl *text, const char *error_message);
         static double _parse_double(const wxTextCtrl *text, const char *error_message);
-        static std::set<const Boxing::Rectangle*> _get_changes(const std::vector<Boxing::Box> &a, const std::vector<Boxing::Box> &b);
-        static std::set<const Boxing::Rectangle*> _get_changes(const BoxingNeighborhoodOrder::Solution &a, const BoxingNeighborhoodOrder::Solution &b);
         void _draw_rectangle(wxDC *dc ,const Boxing::BoxedRectangle *rectangle,
             const unsigned int box_size, const unsigned int local_x, unsigned int local_y);
+        void _draw_box(const Boxing::Box &box, unsigned int box_size, BoxBitmap *box_bitmap);
+        void _update_changes();
+        void _solve(Settings settings);
+        template <class Problem> bool _report(const Problem &problem, const typename Problem::Solution &solution, unsigned int iteration, double heuristic,
+            std::chrono::steady_clock::time_point *reported);
 
         //Events
         void _on_run(wxCommandEvent &event);
+        void _on_cancel(wxCommandEvent &event);
+        void _on_progress(wxThreadEvent &event);
+        void _on_result(wxThreadEvent &event);
         void _on_next(wxCommandEvent &event);
         void _on_previous(wxCommandEvent &event);
         void _on_scroll(wxScrollEvent &event);
@@ -85,6 +198,7 @@ namespace opt
 
     public:
         Frame();
+        ~Frame();
     };
 
     class App : public wxApp
@@ -114,10 +228,74 @@ double opt::Frame::_parse_double(const wxTextCtrl *text, const char *error_messa
     return result;
 }
 
-std::set<const opt::Boxing::Rectangle*> opt::Frame::_get_changes(const std::vector<Boxing::Box> &a, const std::vector<Boxing::Box> &b)
+const std::vector<opt::Boxing::Box> &opt::Log::boxes(size_t iteration)
+{
+    //Recently shown iteration moves to the front
+    auto found = _recent_index.find(iteration);
+    if (found != _recent_index.end())
+    {
+        _recent.splice(_recent.begin(), _recent, found->second);
+        return _recent.front().second;
+    }
+
+    //Least recently shown iteration is forgotten
+    if (_recent.size() == _recent_max)
+    {
+        _recent_index.erase(_recent.back().first);
+        _recent.pop_back();
+    }
+    _recent.emplace_front(iteration, _get_boxes(iteration));
+    _recent_index[iteration] = _recent.begin();
+    return _recent.front().second;
+}
+
+const std::vector<unsigned int> &opt::Log::changes(size_t iteration)
+{
+    if (_changes.size() != size())
+    {
+        _changes.resize(size());
+        _changes_found.resize(size(), false);
+    }
+    if (!_changes_found[iteration])
+    {
+        _changes[iteration] = _find_changes(iteration);
+        _changes_found[iteration] = true;
+    }
+    return _changes[iteration];
+}
+
+std::vector<unsigned int> opt::Log::_find_changes(size_t iteration)
+{
+    //Boxes of iteration stay cached while boxes of next one are made
+    const std::vector<Boxing::Box> &a = boxes(iteration);
+    const std::vector<Boxing::Box> &b = boxes(iteration + 1);
+    return _get_changes(a, b);
+}
+
+template <class Problem> opt::ProblemLog<Problem>::ProblemLog(const Problem *problem, std::vector<typename Problem::Solution> &&solutions)
+    : _problem(problem), _solutions(std::move(solutions))
+{}
+
+template <class Problem> std::vector<opt::Boxing::Box> opt::ProblemLog<Problem>::_get_boxes(size_t iteration) const
+{
+    return _problem->get_boxes(_solutions[iteration]);
+}
+
+template <class Problem> size_t opt::ProblemLog<Problem>::size() const
+{
+    return _solutions.size();
+}
+
+std::vector<unsigned int> opt::OrderLog::_find_changes(size_t iteration)
+{
+    return _get_changes(_solutions[iteration], _solutions[iteration + 1]);
+}
+
+std::vector<unsigned int> opt::Log::_get_changes(const std::vector<Boxing::Box> &a, const std::vector<Boxing::Box> &b)
 {
     typedef std::vector<Boxing::Box>::const_iterator box_iter;
-    typedef std::vector<Boxing::BoxedRectangle>::const_iterator rectangle_iter;
+    typedef size_t rectangle_iter;
+    const unsigned int none = std::numeric_limits<unsigned int>::max();
     struct Util
     {
         static void find_initial(const std::vector<Boxing::Box> &boxes, box_iter &box, rectangle_iter &rectangle)
@@ -126,8 +304,8 @@ std::set<const opt::Boxing::Rectangle*> opt::Frame::_get_changes(const std::vect
             while (true)
             {
                 if (box == boxes.cend()) break; //Fail
-                rectangle = box->rectangles.begin();
-                if (rectangle != box->rectangles.cend()) break; //Success
+                rectangle = 0;
+                if (rectangle != box->size()) break; //Success
                 box++;
             }
         }
@@ -136,29 +314,29 @@ std::set<const opt::Boxing::Rectangle*> opt::Frame::_get_changes(const std::vect
             rectangle++;
             while (true)
             {
-                if (rectangle != box->rectangles.cend()) break; //Success
+                if (rectangle != box->size()) break; //Success
                 box++;
                 if (box == boxes.cend()) break; //Fail
-                rectangle = box->rectangles.begin();
+                rectangle = 0;
             }
         }
         static bool valid(const std::vector<Boxing::Box> &boxes, box_iter box, rectangle_iter rectangle)
         {
-            return box != boxes.cend() && rectangle != box->rectangles.cend();
+            return box != boxes.cend() && rectangle != box->size();
         }
     };
     box_iter a_box, b_box;
-    rectangle_iter a_rectangle, b_rectangle;
+    rectangle_iter a_rectangle = 0, b_rectangle = 0;
     Util::find_initial(a, a_box, a_rectangle);
     Util::find_initial(b, b_box, b_rectangle);
-    std::set<const opt::Boxing::Rectangle*> changes;
+    std::vector<unsigned int> changes;
 
     while (true)
     {
-        const Boxing::Rectangle *a_rectangle_p = Util::valid(a, a_box, a_rectangle) ? a_rectangle->rectangle : nullptr;
-        const Boxing::Rectangle *b_rectangle_p = Util::valid(b, b_box, b_rectangle) ? b_rectangle->rectangle : nullptr;
+        const unsigned int a_rectangle_p = Util::valid(a, a_box, a_rectangle) ? (*a_box)[a_rectangle].rectangle() : none;
+        const unsigned int b_rectangle_p = Util::valid(b, b_box, b_rectangle) ? (*b_box)[b_rectangle].rectangle() : none;
 
-        if (a_rectangle_p == nullptr && b_rectangle_p == nullptr)
+        if (a_rectangle_p == none && b_rectangle_p == none)
         {
             //Reached end
             break;
@@ -168,10 +346,10 @@ std::set<const opt::Boxing::Rectangle*> opt::Frame::_get_changes(const std::vect
             //Different rectangles
             box_iter next_a_box = a_box, next_b_box = b_box;
             rectangle_iter next_a_rectangle = a_rectangle, next_b_rectangle = b_rectangle;
-            if (a_rectangle_p != nullptr) Util::find_next(a, next_a_box, next_a_rectangle);
-            if (b_rectangle_p != nullptr) Util::find_next(b, next_b_box, next_b_rectangle);
-            const Boxing::Rectangle *next_a_rectangle_p = Util::valid(a, next_a_box, next_a_rectangle) ? next_a_rectangle->rectangle : nullptr;
-            const Boxing::Rectangle *next_b_rectangle_p = Util::valid(b, next_b_box, next_b_rectangle) ? next_b_rectangle->rectangle : nullptr;
+            if (a_rectangle_p != none) Util::find_next(a, next_a_box, next_a_rectangle);
+            if (b_rectangle_p != none) Util::find_next(b, next_b_box, next_b_rectangle);
+            const unsigned int next_a_rectangle_p = Util::valid(a, next_a_box, next_a_rectangle) ? (*next_a_box)[next_a_rectangle].rectangle() : none;
+            const unsigned int next_b_rectangle_p = Util::valid(b, next_b_box, next_b_rectangle) ? (*next_b_box)[next_b_rectangle].rectangle() : none;
             
             const bool insert_a = next_a_rectangle_p == b_rectangle_p;
             const bool insert_b = next_b_rectangle_p == a_rectangle_p;
@@ -180,13 +358,13 @@ std::set<const opt::Boxing::Rectangle*> opt::Frame::_get_changes(const std::vect
             {
                 a_box = next_a_box;
                 a_rectangle = next_a_rectangle;
-                if (a_rectangle_p != nullptr) changes.insert(a_rectangle_p);
+                if (a_rectangle_p != none) changes.push_back(a_rectangle_p);
             }
             if (insert_b)
             {
                 b_box = next_b_box;
                 b_rectangle = next_b_rectangle;
-                if (b_rectangle_p != nullptr) changes.insert(b_rectangle_p);
+                if (b_rectangle_p != none) changes.push_back(b_rectangle_p);
             }
             if (swap_ab)
             {
@@ -194,11 +372,12 @@ std::set<const opt::Boxing::Rectangle*> opt::Frame::_get_changes(const std::vect
                 if (Util::valid(b, b_box, b_rectangle)) Util::find_next(b, b_box, b_rectangle);
             }
         }
-        else if (a_rectangle->x != b_rectangle->x || a_rectangle->y != b_rectangle->y || a_rectangle->transposed != b_rectangle->transposed
+        else if ((*a_box)[a_rectangle].x != (*b_box)[b_rectangle].x || (*a_box)[a_rectangle].y != (*b_box)[b_rectangle].y
+        || (*a_box)[a_rectangle].transposed() != (*b_box)[b_rectangle].transposed()
         || static_cast<size_t>(a_box - a.begin()) != static_cast<size_t>(b_box - b.begin()))
         {
             //Different rectangle positions
-            changes.insert(a_rectangle->rectangle);
+            changes.push_back(a_rectangle_p);
             Util::find_next(a, a_box, a_rectangle);
             Util::find_next(b, b_box, b_rectangle);
         }
@@ -209,68 +388,73 @@ std::set<const opt::Boxing::Rectangle*> opt::Frame::_get_changes(const std::vect
             Util::find_next(b, b_box, b_rectangle);
         }
     }
+    std::sort(changes.begin(), changes.end());
+    changes.erase(std::unique(changes.begin(), changes.end()), changes.end());
     return changes;
 }
 
-std::set<const opt::Boxing::Rectangle*> opt::Frame::_get_changes(const BoxingNeighborhoodOrder::Solution &a, const BoxingNeighborhoodOrder::Solution &b)
+std::vector<unsigned int> opt::Log::_get_changes(const BoxingNeighborhoodOrder::Solution &a, const BoxingNeighborhoodOrder::Solution &b)
 {
-    auto a_rectangle = a.begin();
-    auto b_rectangle = b.begin();
-    std::set<const opt::Boxing::Rectangle*> changes;
+    const unsigned int none = std::numeric_limits<unsigned int>::max();
+    auto a_rectangle = a.items().cbegin();
+    auto b_rectangle = b.items().cbegin();
+    std::vector<unsigned int> changes;
     while (true)
     {
-        const Boxing::Rectangle *a_rectangle_p = a_rectangle != a.cend() ? *a_rectangle : nullptr;
-        const Boxing::Rectangle *b_rectangle_p = b_rectangle != b.cend() ? *b_rectangle : nullptr;
+        const unsigned int a_rectangle_i = a_rectangle != a.items().cend() ? *a_rectangle : none;
+        const unsigned int b_rectangle_i = b_rectangle != b.items().cend() ? *b_rectangle : none;
 
-        if (a_rectangle_p == nullptr && b_rectangle_p == nullptr)
+        if (a_rectangle_i == none && b_rectangle_i == none)
         {
             //Reached end
             break;
         }
-        else if (a_rectangle_p != b_rectangle_p)
+        else if (a_rectangle_i != b_rectangle_i)
         {
             //Different rectangles
             auto next_a_rectangle = a_rectangle + 1;
             auto next_b_rectangle = b_rectangle + 1;
-            const Boxing::Rectangle *next_a_rectangle_p = next_a_rectangle != a.cend() ? *next_a_rectangle : nullptr;
-            const Boxing::Rectangle *next_b_rectangle_p = next_b_rectangle != b.cend() ? *next_b_rectangle : nullptr;
+            const unsigned int next_a_rectangle_i = next_a_rectangle != a.items().cend() ? *next_a_rectangle : none;
+            const unsigned int next_b_rectangle_i = next_b_rectangle != b.items().cend() ? *next_b_rectangle : none;
             
-            const bool insert_a = next_a_rectangle_p == b_rectangle_p;
-            const bool insert_b = next_b_rectangle_p == a_rectangle_p;
+            const bool insert_a = next_a_rectangle_i == b_rectangle_i;
+            const bool insert_b = next_b_rectangle_i == a_rectangle_i;
             const bool swap_ab = insert_a && insert_b;
             if (insert_a)
             {
                 a_rectangle++;
-                if (a_rectangle_p != nullptr) changes.insert(a_rectangle_p);
+                if (a_rectangle_i != none) changes.push_back(a_rectangle_i);
             }
             if (insert_b)
             {
                 b_rectangle++;
-                if (b_rectangle_p != nullptr) changes.insert(b_rectangle_p);
+                if (b_rectangle_i != none) changes.push_back(b_rectangle_i);
             }
             if (swap_ab)
             {
-                if (a_rectangle != a.cend()) a_rectangle++;
-                if (b_rectangle != b.cend()) b_rectangle++;
+                if (a_rectangle != a.items().cend()) a_rectangle++;
+                if (b_rectangle != b.items().cend()) b_rectangle++;
             }
         }
         else
         {
             //Same rectangles
-            if (a_rectangle != a.cend()) a_rectangle++;
-            if (b_rectangle != b.cend()) b_rectangle++;
+            if (a_rectangle != a.items().cend()) a_rectangle++;
+            if (b_rectangle != b.items().cend()) b_rectangle++;
         }
     }
+    std::sort(changes.begin(), changes.end());
+    changes.erase(std::unique(changes.begin(), changes.end()), changes.end());
     return changes;
 }
 
 void opt::Frame::_draw_rectangle(wxDC *dc ,const Boxing::BoxedRectangle *rectangle,
     const unsigned int box_size, const unsigned int local_x, unsigned int local_y)
 {
-    const unsigned int rectangle_x_begin = box_size * rectangle->x / _boxing->box_size();
-    const unsigned int rectangle_x_end = box_size * rectangle->x_end() / _boxing->box_size();
-    const unsigned int rectangle_y_begin = box_size * rectangle->y / _boxing->box_size();
-    const unsigned int rectangle_y_end = box_size * rectangle->y_end() / _boxing->box_size();
+    const unsigned int rectangle_x_begin = box_size * rectangle->x / _box_size;
+    const unsigned int rectangle_x_end = box_size * rectangle->x_end() / _box_size;
+    const unsigned int rectangle_y_begin = box_size * rectangle->y / _box_size;
+    const unsigned int rectangle_y_end = box_size * rectangle->y_end() / _box_size;
     dc->DrawRectangle(
         local_x + rectangle_x_begin, local_y + box_size - rectangle_y_end,
         rectangle_x_end - rectangle_x_begin, rectangle_y_end - rectangle_y_begin);
@@ -290,118 +474,302 @@ void opt::Frame::_draw_rectangle(wxDC *dc ,const Boxing::BoxedRectangle *rectang
 
 void opt::Frame::_on_run(wxCommandEvent &)
 {
+    Settings settings;
     try
     {
-        Mode mode = static_cast<Mode>(_selector_mode->GetSelection());
+        settings.mode = static_cast<Mode>(_selector_mode->GetSelection());
 
         //Problem
-        const unsigned int box_size = _parse_uint(_edit_box_size, "Invalid box size");
-        const unsigned int item_number = _parse_uint(_edit_item_number, "Invalid item number size");
-        const unsigned int item_size_min = _parse_uint(_edit_item_size_min, "Invalid minimal item size");
-        const unsigned int item_size_max = _parse_uint(_edit_item_size_max, "Invalid maximal item size");
-        const unsigned int seed = _parse_uint(_edit_seed, "Invalid seed");
-        const unsigned int window = _parse_uint(_edit_window, "Invalid window size");
-        const unsigned int hwindow = _parse_uint(_edit_hwindow, "Invalid vertical window size");
-        const unsigned int desired_iter = _parse_uint(_edit_desired_iter, "Invalid desired iteration");
+        settings.box_size = _parse_uint(_edit_box_size, "Invalid box size");
+        settings.item_number = _parse_uint(_edit_item_number, "Invalid item number size");
+        settings.item_size_min = _parse_uint(_edit_item_size_min, "Invalid minimal item size");
+        settings.item_size_max = _parse_uint(_edit_item_size_max, "Invalid maximal item size");
+        settings.seed = _parse_uint(_edit_seed, "Invalid seed");
+        settings.window = _parse_uint(_edit_window, "Invalid window size");
+        settings.hwindow = _parse_uint(_edit_hwindow, "Invalid vertical window size");
+        settings.desired_iter = _parse_uint(_edit_desired_iter, "Invalid desired iteration");
+        if (settings.box_size == 0) throw std::runtime_error("Invalid box size");
 
         //Solution
-        const unsigned int iter_max = _parse_uint(_edit_iter_max, "Invalid iteration limit");
-        const double time_max = _parse_double(_edit_time_max, "Invalid time limit");
-        const bool return_good = _check_return_good->GetValue();
+        settings.iter_max = _parse_uint(_edit_iter_max, "Invalid iteration limit");
+        settings.time_max = _parse_double(_edit_time_max, "Invalid time limit");
+        settings.return_good = _check_return_good->GetValue();
+    }
+    catch (const std::exception &e)
+    {
+        wxMessageBox(e.what(), "Exception", wxICON_ERROR);
+        return;
+    }
+
+    //Display shows the latest solution until the log arrives, previous log refers to previous problem
+    _mode = settings.mode;
+    _log.reset();
+    _boxing.reset();
+    _live.clear();
+    _box_size = settings.box_size;
+    _iteration = 0;
+    _changes_iteration = _no_iteration;
+    _scroll_scroll->SetScrollbar(0, 1, 1, 1);
+    _text_iteration->SetLabel("Iteration: N/A");
+    _text_time->SetLabel("Time: N/A");
+    _panel_display->Refresh();
+
+    //Problem is created and solved in background, bounds computed by its constructor would freeze the frame
+    _button_run->Disable();
+    _button_cancel->Enable();
+    _cancel = false;
+    _start = std::chrono::steady_clock::now();
+    _solver = std::thread(&Frame::_solve, this, settings);
+}
 
-        double timer;
+void opt::Frame::_solve(Settings settings)
+{
+    std::shared_ptr<Result> result = std::make_shared<Result>();
+    std::chrono::steady_clock::time_point reported = _start;
+    const Mode mode = settings.mode;
+    try
+    {
         if (mode == Mode::greedy_area || mode == Mode::greedy_max || mode == Mode::greedy_min)
         {
-            BoxingGreedy::Metric metric;
-            if (mode == Mode::greedy_area) metric = BoxingGreedy::Metric::area;
-            else if (mode == Mode::greedy_max) metric = BoxingGreedy::Metric::max_size;
-            else metric = BoxingGreedy::Metric::min_size;
             typedef BoxingGreedy Problem;
-            Problem *problem = new Problem(box_size, item_number, item_size_min, item_size_max, seed, metric);
-            _boxing.reset(problem);
+            Problem::Metric metric;
+            if (mode == Mode::greedy_area) metric = Problem::Metric::area;
+            else if (mode == Mode::greedy_max) metric = Problem::Metric::max_size;
+            else metric = Problem::Metric::min_size;
+            Problem *problem = new Problem(settings.box_size, settings.item_number, settings.item_size_min, settings.item_size_max, settings.seed, metric);
+            result->boxing.reset(problem);
             std::vector<Problem::Solution> log;
-            Problem::Solution solution = greedy(*problem, &log, &timer);
-            _log.resize(log.size());
-            for (unsigned int i = 0; i < log.size(); i++) _log[i] = problem->get_boxes(log[i]);
+            greedy(*problem, &log, &result->timer, nullptr, [this, problem, &reported](const Problem::Solution &solution, unsigned int joined)
+            {
+                return _report(*problem, solution, joined, std::numeric_limits<double>::quiet_NaN(), &reported);
+            });
+            result->log = std::make_shared<ProblemLog<Problem>>(problem, std::move(log));
         }
         else if (mode == Mode::neighborhood_geometry)
         {
             typedef BoxingNeighborhoodGeometry Problem;
-            Problem *problem = new Problem(box_size, item_number, item_size_min, item_size_max, seed, window, hwindow);
-            _boxing.reset(problem);
+            Problem *problem = new Problem(settings.box_size, settings.item_number, settings.item_size_min, settings.item_size_max, settings.seed,
+                settings.window, settings.hwindow);
+            result->boxing.reset(problem);
             std::vector<Problem::Solution> log;
-            Problem::Solution solution = neighborhood(*problem, iter_max, time_max, return_good, &log, &timer);
-            _log.resize(log.size());
-            for (unsigned int i = 0; i < log.size(); i++) _log[i] = problem->get_boxes(log[i]);
+            neighborhood(*problem, settings.iter_max, settings.time_max, settings.return_good, &log, &result->timer, 0, nullptr, nullptr, 0,
+                [this, problem, &reported](const Problem::Solution &solution, unsigned int iter, double heuristic)
+            {
+                return _report(*problem, solution, iter, heuristic, &reported);
+            });
+            result->log = std::make_shared<ProblemLog<Problem>>(problem, std::move(log));
         }
         else if (mode == Mode::neighborhood_order)
         {
             typedef BoxingNeighborhoodOrder Problem;
-            Problem *problem = new Problem(box_size, item_number, item_size_min, item_size_max, seed, window);
-            _boxing.reset(problem);
+            Problem *problem = new Problem(settings.box_size, settings.item_number, settings.item_size_min, settings.item_size_max, settings.seed,
+                settings.window);
+            result->boxing.reset(problem);
             std::vector<Problem::Solution> log;
-            Problem::Solution solution = neighborhood(*problem, iter_max, time_max, return_good, &log, &timer);
-            _log.resize(log.size());
-            _log_order.resize(log.size());
-            for (unsigned int i = 0; i < log.size(); i++) { _log[i] = problem->get_boxes(log[i]); _log_order[i] = log[i]; }
+            neighborhood(*problem, settings.iter_max, settings.time_max, settings.return_good, &log, &result->timer, 0, nullptr, nullptr, 0,
+                [this, problem, &reported](const Problem::Solution &solution, unsigned int iter, double heuristic)
+            {
+                return _report(*problem, solution, iter, heuristic, &reported);
+            });
+            result->log = std::make_shared<OrderLog>(problem, std::move(log));
         }
         else
         {
             typedef BoxingNeighborhoodGeometryOverlap Problem;
-            Problem *problem = new Problem(box_size, item_number, item_size_min, item_size_max, seed, window, hwindow, desired_iter);
-            _boxing.reset(problem);
+            Problem *problem = new Problem(settings.box_size, settings.item_number, settings.item_size_min, settings.item_size_max, settings.seed,
+                settings.window, settings.hwindow, settings.desired_iter);
+            result->boxing.reset(problem);
             std::vector<Problem::Solution> log;
-            Problem::Solution solution = neighborhood(*problem, iter_max, time_max, return_good, &log, &timer);
-            _log.resize(log.size());
-            for (unsigned int i = 0; i < log.size(); i++) _log[i] = problem->get_boxes(log[i]);
+            neighborhood(*problem, settings.iter_max, settings.time_max, settings.return_good, &log, &result->timer, 0, nullptr, nullptr, 0,
+                [this, problem, &reported](const Problem::Solution &solution, unsigned int iter, double heuristic)
+            {
+                return _report(*problem, solution, iter, heuristic, &reported);
+            });
+            result->log = std::make_shared<ProblemLog<Problem>>(problem, std::move(log));
         }
-        _mode = mode;
-        _iteration = _log.size() - 1;
-        _scroll_scroll->SetScrollbar(_iteration, _log.size() / 10, _log.size(), 10);
-        _text_iteration->SetLabel("Iteration: " + std::to_string(_iteration + 1) + "/" + std::to_string(_log.size()));
-        _text_time->SetLabel("Time: " + std::to_string(timer));
     }
     catch (const std::exception &e)
     {
-        wxMessageBox(e.what(), "Exception", wxICON_ERROR);
+        result->error = e.what();
+    }
+
+    wxThreadEvent *event = new wxThreadEvent(wxEVT_THREAD, _id_result);
+    event->SetPayload(result);
+    wxQueueEvent(this, event);
+}
+
+template <class Problem> bool opt::Frame::_report(const Problem &problem, const typename Problem::Solution &solution, unsigned int iteration, double heuristic,
+    std::chrono::steady_clock::time_point *reported)
+{
+    //Latest solution is sent at most ten times a second
+    const std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+    if (now - *reported >= std::chrono::milliseconds(100))
+    {
+        *reported = now;
+        std::shared_ptr<Progress> progress = std::make_shared<Progress>();
+        progress->iteration = iteration;
+        progress->heuristic = heuristic;
+        progress->elapsed = std::chrono::duration<double>(now - _start).count();
+        progress->boxes = problem.get_boxes(solution);
+        wxThreadEvent *event = new wxThreadEvent(wxEVT_THREAD, _id_progress);
+        event->SetPayload(progress);
+        wxQueueEvent(this, event);
     }
+    return !_cancel;
+}
+
+void opt::Frame::_on_cancel(wxCommandEvent &)
+{
+    _cancel = true;
+}
+
+void opt::Frame::_on_progress(wxThreadEvent &event)
+{
+    std::shared_ptr<Progress> progress = event.GetPayload<std::shared_ptr<Progress>>();
+    _live = std::move(progress->boxes);
+    _iteration = 0;
+    _changes_iteration = _no_iteration;
+    std::string label = "Iteration: " + std::to_string(progress->iteration + 1);
+    if (!std::isnan(progress->heuristic)) label += ", heuristic: " + std::to_string(progress->heuristic);
+    _text_iteration->SetLabel(label);
+    _text_time->SetLabel("Time: " + std::to_string(progress->elapsed));
+    _panel_display->Refresh();
+}
+
+void opt::Frame::_on_result(wxThreadEvent &event)
+{
+    _solver.join();
+    _button_run->Enable();
+    _button_cancel->Disable();
+    std::shared_ptr<Result> result = event.GetPayload<std::shared_ptr<Result>>();
+    if (!result->error.empty() || result->log == nullptr || result->log->size() == 0)
+    {
+        _log.reset();
+        _live.clear();
+        _changes_iteration = _no_iteration;
+        _text_iteration->SetLabel("Iteration: N/A");
+        _panel_display->Refresh();
+        if (!result->error.empty()) wxMessageBox(result->error, "Exception", wxICON_ERROR);
+        return;
+    }
+
+    _boxing = std::move(result->boxing);
+    _log = result->log;
+    _live.clear();
+    _iteration = _log->size() - 1;
+    _changes_iteration = _no_iteration;
+    _scroll_scroll->SetScrollbar(_iteration, _log->size() / 10, _log->size(), 10);
+    _text_iteration->SetLabel("Iteration: " + std::to_string(_iteration + 1) + "/" + std::to_string(_log->size()));
+    _text_time->SetLabel("Time: " + std::to_string(result->timer));
+    _panel_display->Refresh();
 }
 
 void opt::Frame::_on_next(wxCommandEvent &)
 {
-    if (_iteration + 1 < _log.size())
+    if (_log != nullptr && _iteration + 1 < _log->size())
     {
         _iteration++;
-        _scroll_scroll->SetScrollbar(_iteration, _log.size() / 10, _log.size(), 10);
-        _text_iteration->SetLabel("Iteration: " + std::to_string(_iteration + 1) + "/" + std::to_string(_log.size()));
+        _scroll_scroll->SetScrollbar(_iteration, _log->size() / 10, _log->size(), 10);
+        _text_iteration->SetLabel("Iteration: " + std::to_string(_iteration + 1) + "/" + std::to_string(_log->size()));
         _panel_display->Refresh();
     }
 }
 
 void opt::Frame::_on_previous(wxCommandEvent &)
 {
-    if (_iteration > 0)
+    if (_log != nullptr && _iteration > 0)
     {
         _iteration--;
-        _scroll_scroll->SetScrollbar(_iteration, _log.size() / 10, _log.size(), 10);
-        _text_iteration->SetLabel("Iteration: " + std::to_string(_iteration + 1) + "/" + std::to_string(_log.size()));
+        _scroll_scroll->SetScrollbar(_iteration, _log->size() / 10, _log->size(), 10);
+        _text_iteration->SetLabel("Iteration: " + std::to_string(_iteration + 1) + "/" + std::to_string(_log->size()));
         _panel_display->Refresh();
     }
 }
 
 void opt::Frame::_on_scroll(wxScrollEvent &)
 {
+    if (_log == nullptr) return;
     _iteration = _scroll_scroll->GetScrollPos(wxHORIZONTAL);
-    if (_iteration > _log.size() - 1) _iteration = _log.size() - 1;
-    _text_iteration->SetLabel("Iteration: " + std::to_string(_iteration + 1) + "/" + std::to_string(_log.size()));
+    if (_iteration > _log->size() - 1) _iteration = _log->size() - 1;
+    _text_iteration->SetLabel("Iteration: " + std::to_string(_iteration + 1) + "/" + std::to_string(_log->size()));
     _panel_display->Refresh();
 }
 
+void opt::Frame::_update_changes()
+{
+    //Changes are looked up once per shown iteration, not on every paint
+    if (_changes_iteration == _iteration) return;
+    _changes_iteration = _iteration;
+    _yellow.clear();
+    _blue.clear();
+    if (_log == nullptr) return;
+
+    //Changes between previous and current are yellow, changes between current and next are blue
+    if (_iteration > 0) _yellow = _log->changes(_iteration - 1);
+    if (_iteration + 1 < _log->size()) _blue = _log->changes(_iteration);
+
+    //Geometry moves show the first changed rectangle only
+    if (_mode != Mode::neighborhood_order)
+    {
+        if (_yellow.size() > 1) _yellow.resize(1);
+        if (_blue.size() > 1) _blue.resize(1);
+    }
+}
+
+void opt::Frame::_draw_box(const Boxing::Box &box, unsigned int box_size, BoxBitmap *box_bitmap)
+{
+    //Rectangles are grey, blue, yellow or green, drawn in this order
+    enum { grey, blue, yellow, green };
+    //Rectangle coordinates are in problem units, so the key holds both the pixel and the problem box size
+    std::vector<unsigned int> key;
+    key.reserve(2 + 3 * box.size());
+    key.push_back(box_size);
+    key.push_back(_box_size);
+    for (size_t rectangle_i = 0; rectangle_i < box.size(); rectangle_i++)
+    {
+        const Boxing::BoxedRectangle rectangle = box[rectangle_i];
+        const bool is_yellow = std::binary_search(_yellow.cbegin(), _yellow.cend(), rectangle.rectangle());
+        const bool is_blue = std::binary_search(_blue.cbegin(), _blue.cend(), rectangle.rectangle());
+        key.push_back(rectangle.x | (static_cast<unsigned int>(rectangle.y) << 16));
+        key.push_back(rectangle.width | (static_cast<unsigned int>(rectangle.height) << 16));
+        key.push_back(is_yellow ? (is_blue ? green : yellow) : (is_blue ? blue : grey));
+    }
+    if (key == box_bitmap->key && box_bitmap->bitmap.IsOk()) return;
+    box_bitmap->key = std::move(key);
+
+    //Border of width 2 reaches one pixel outside of the box
+    box_bitmap->bitmap = wxBitmap(box_size + 2, box_size + 2);
+    wxMemoryDC dc(box_bitmap->bitmap);
+    dc.SetBackground(*wxWHITE_BRUSH);
+    dc.Clear();
+    wxPen pen(*wxBLACK, 2);
+    dc.SetPen(pen);
+    const wxBrush *brushes[] = { wxGREY_BRUSH, wxBLUE_BRUSH, wxYELLOW_BRUSH, wxGREEN_BRUSH };
+    for (unsigned int color = grey; color <= green; color++)
+    {
+        dc.SetBrush(*brushes[color]);
+        for (size_t rectangle_i = 0; rectangle_i < box.size(); rectangle_i++)
+        {
+            const Boxing::BoxedRectangle rectangle = box[rectangle_i];
+            if (box_bitmap->key[3 * rectangle_i + 4] == color) _draw_rectangle(&dc, &rectangle, box_size, 1, 1);
+        }
+    }
+
+    //Draw border
+    dc.DrawLine(1, 1, 1, 1 + box_size);
+    dc.DrawLine(1, 1 + box_size, 1 + box_size, 1 + box_size);
+    dc.DrawLine(1 + box_size, 1 + box_size, 1 + box_size, 1);
+    dc.DrawLine(1 + box_size, 1, 1, 1);
+}
+
 void opt::Frame::_on_paint(wxPaintEvent &)
 {
-    wxPaintDC dc(_panel_display);
-    if (_log.empty()) return;
-    const std::vector<Boxing::Box> &boxes = _log[_iteration];
+    //Drawn to a buffer shown at once, boxes are copied from their bitmaps
+    wxAutoBufferedPaintDC dc(_panel_display);
+    dc.SetBackground(*wxWHITE_BRUSH);
+    dc.Clear();
+    _update_changes();
+    const std::vector<Boxing::Box> &boxes = (_log != nullptr) ? _log->boxes(_iteration) : _live;
     if (boxes.empty()) return;
 
     //Calculate sizes
@@ -416,81 +784,16 @@ void opt::Frame::_on_paint(wxPaintEvent &)
     const unsigned int box_offset_x = (box_margin_width - box_size) / 2;
     const unsigned int box_offset_y = (box_margin_height - box_size) / 2;
 
-    //Find selection
-    std::set<const Boxing::Rectangle*> yellow, blue;
-    if (_mode == Mode::neighborhood_order)
-    {
-        //Changes between previous and current are yellow
-        if (_iteration > 0) yellow = _get_changes(_log_order[_iteration - 1], _log_order[_iteration]);
-        //Changes between current and next are blue
-        if (_iteration + 1 < _log_order.size()) blue = _get_changes(_log_order[_iteration], _log_order[_iteration + 1]);
-    }
-    else
-    {
-        //Changes between previous and current are yellow
-        if (_iteration > 0) yellow = _get_changes(_log[_iteration - 1], _log[_iteration]);
-        if (yellow.size() > 1) yellow.erase(++yellow.cbegin(), yellow.cend());
-        //Changes between current and next are blue
-        if (_iteration + 1 < _log.size()) blue = _get_changes(_log[_iteration], _log[_iteration + 1]);
-        if (blue.size() > 1) blue.erase(++blue.cbegin(), blue.cend());
-    }
-
-    //Clear background
-    dc.SetBackground(*wxWHITE_BRUSH);
-    dc.Clear();
-
     //Draw boxes
-    wxPen pen(*wxBLACK, 2);
-    dc.SetPen(pen);
+    if (_box_bitmaps.size() < boxes.size()) _box_bitmaps.resize(boxes.size());
     for (unsigned int box_i = 0; box_i < boxes.size(); box_i++)
     {
         const unsigned int boxes_x = box_i % boxes_width;
         const unsigned int boxes_y = box_i / boxes_width;
         const unsigned int local_x = box_margin_width * boxes_x + box_offset_x;
         const unsigned int local_y = box_margin_height * boxes_y + box_offset_y;
-
-        //Draw grey rectangles
-        dc.SetBrush(*wxGREY_BRUSH);
-        for (auto rectangle = boxes[box_i].rectangles.cbegin(); rectangle != boxes[box_i].rectangles.cend(); rectangle++)
-        {
-            if (yellow.count(rectangle->rectangle) == 0 && blue.count(rectangle->rectangle) == 0) _draw_rectangle(&dc, &(*rectangle), box_size, local_x, local_y);
-        }   
-
-        //Draw blue rectangles
-        dc.SetBrush(*wxBLUE_BRUSH);
-        for (auto rectangle = boxes[box_i].rectangles.cbegin(); rectangle != boxes[box_i].rectangles.cend(); rectangle++)
-        {
-            if (yellow.count(rectangle->rectangle) == 0 && blue.count(rectangle->rectangle) > 0) _draw_rectangle(&dc, &(*rectangle), box_size, local_x, local_y);
-        }
-
-        //Draw yellow rectangles
-        dc.SetBrush(*wxYELLOW_BRUSH);
-        for (auto rectangle = boxes[box_i].rectangles.cbegin(); rectangle != boxes[box_i].rectangles.cend(); rectangle++)
-        {
-            if (yellow.count(rectangle->rectangle) > 0 && blue.count(rectangle->rectangle) == 0) _draw_rectangle(&dc, &(*rectangle), box_size, local_x, local_y);
-        }
-
-
-        //Draw green rectangles
-        dc.SetBrush(*wxGREEN_BRUSH);
-        for (auto rectangle = boxes[box_i].rectangles.cbegin(); rectangle != boxes[box_i].rectangles.cend(); rectangle++)
-        {
-            if (yellow.count(rectangle->rectangle) > 0 && blue.count(rectangle->rectangle) > 0) _draw_rectangle(&dc, &(*rectangle), box_size, local_x, local_y);
-        }
-
-        //Draw border
-        dc.DrawLine(
-            local_x + 0, local_y + 0,
-            local_x + 0, local_y + box_size);
-        dc.DrawLine(
-            local_x + 0, local_y + box_size,
-            local_x + box_size, local_y + box_size);
-        dc.DrawLine(
-            local_x + box_size, local_y + box_size,
-            local_x + box_size, local_y + 0);
-        dc.DrawLine(
-            local_x + box_size, local_y + 0,
-            local_x + 0, local_y + 0);
+        _draw_box(boxes[box_i], box_size, &_box_bitmaps[box_i]);
+        dc.DrawBitmap(_box_bitmaps[box_i].bitmap, local_x - 1, local_y - 1);
     }
 }
 
@@ -535,13 +838,19 @@ opt::Frame::Frame() : wxFrame(nullptr, wxID_ANY, "Optimization algorithms")
     //Technical
     sizer->Add(vsizer, 0, wxEXPAND);
     sizer->Add(_button_run = new wxButton(this, wxID_ANY, "Run"), 0, wxEXPAND);
+    sizer->Add(_button_cancel = new wxButton(this, wxID_ANY, "Cancel"), 0, wxEXPAND);
+    _button_cancel->Disable();
     sizer->Add(_button_next = new wxButton(this, wxID_ANY, "Next"), 0, wxEXPAND);
     sizer->Add(_button_previous = new wxButton(this, wxID_ANY, "Previous"), 0, wxEXPAND);
     sizer->Add(_panel_display = new wxPanel(this, wxID_ANY), 1, wxEXPAND);
+    _panel_display->SetBackgroundStyle(wxBG_STYLE_PAINT);
     sizer->Add(_scroll_scroll = new wxScrollBar(this, wxID_ANY, wxDefaultPosition, wxDefaultSize, wxSB_HORIZONTAL), 0, wxEXPAND);
     sizer->Add(_text_iteration = new wxStaticText(this, wxID_ANY, "Iteration: N/A"), 0, wxEXPAND);
     sizer->Add(_text_time = new wxStaticText(this, wxID_ANY, "Time: N/A"), 0, wxEXPAND);
     Bind(wxEVT_BUTTON, &Frame::_on_run, this, _button_run->GetId());
+    Bind(wxEVT_BUTTON, &Frame::_on_cancel, this, _button_cancel->GetId());
+    Bind(wxEVT_THREAD, &Frame::_on_progress, this, _id_progress);
+    Bind(wxEVT_THREAD, &Frame::_on_result, this, _id_result);
     Bind(wxEVT_BUTTON, &Frame::_on_next, this, _button_next->GetId());
     Bind(wxEVT_BUTTON, &Frame::_on_previous, this, _button_previous->GetId());
     _panel_display->Bind(wxEVT_PAINT, &Frame::_on_paint, this, _panel_display->GetId());
@@ -554,6 +863,13 @@ opt::Frame::Frame() : wxFrame(nullptr, wxID_ANY, "Optimization algorithms")
     SetPosition(wxPoint(display.GetClientArea().GetSize().GetWidth() / 6, display.GetClientArea().GetSize().GetHeight() / 6));
 }
 
+opt::Frame::~Frame()
+{
+    //Solver reads the problem, events it sends after this are dropped with the frame
+    _cancel = true;
+    if (_solver.joinable()) _solver.join();
+}
+
 bool opt::App::OnInit()
 {
     Frame *frame = new Frame();
@@ -0,0 +1,46 @@
+#include "../include/optalg/heuristic_cache.h"
+#include "../include/optalg/stats.h"
+#include <cstring>
+
+opt::HeuristicCache::HeuristicCache(size_t size)
+{
+    if (size == 0) return;
+    size_t rounded = 1;
+    while (2 * rounded <= size) rounded *= 2;
+    _entries.reset(new Entry[rounded]);
+    _mask = rounded - 1;
+
+    //Empty entry matches no hash but ~0
+    for (size_t i = 0; i < rounded; i++)
+    {
+        _entries[i].check.store(~0ULL, std::memory_order_relaxed);
+        _entries[i].value.store(0, std::memory_order_relaxed);
+    }
+}
+
+size_t opt::HeuristicCache::memory_usage() const
+{
+    return sizeof(*this) + (enabled() ? ((_mask + 1) * sizeof(Entry)) : 0);
+}
+
+bool opt::HeuristicCache::find(unsigned long long hash, double *value) const
+{
+    if (!enabled()) return false;
+    OPTALG_COUNT(cache_lookups, 1);
+    const Entry &entry = _entries[hash & _mask];
+    const unsigned long long bits = entry.value.load(std::memory_order_relaxed);
+    if ((entry.check.load(std::memory_order_relaxed) ^ bits) != hash) return false;
+    OPTALG_COUNT(cache_hits, 1);
+    std::memcpy(value, &bits, sizeof(double));
+    return true;
+}
+
+void opt::HeuristicCache::insert(unsigned long long hash, double value)
+{
+    if (!enabled()) return;
+    unsigned long long bits;
+    std::memcpy(&bits, &value, sizeof(double));
+    Entry &entry = _entries[hash & _mask];
+    entry.value.store(bits, std::memory_order_relaxed);
+    entry.check.store(hash ^ bits, std::memory_order_relaxed);
+}
@@ -0,0 +1,21 @@
+#include "../include/optalg/stats.h"
+#include <algorithm>
+
+void opt::Stats::merge(const Stats &other)
+{
+    neighbors += other.neighbors;
+    dropped += other.dropped;
+    heuristics += other.heuristics;
+    pruned += other.pruned;
+    nodes += other.nodes;
+    probes += other.probes;
+    probe_cells += other.probe_cells;
+    image_cells += other.image_cells;
+    searches += other.searches;
+    placements += other.placements;
+    copied_bytes += other.copied_bytes;
+    neighbor_memory_peak = std::max(neighbor_memory_peak, other.neighbor_memory_peak);
+    allocations += other.allocations;
+    cache_lookups += other.cache_lookups;
+    cache_hits += other.cache_hits;
+}
\ No newline at end of file
@@ -0,0 +1,60 @@
+#include "../include/optalg/trace.h"
+#include <algorithm>
+#include <iomanip>
+#include <limits>
+
+const unsigned int opt::Trace::no_iteration = std::numeric_limits<unsigned int>::max();
+
+opt::Trace::Span::Span(Trace *trace, const char *name, unsigned int thread, unsigned int iteration)
+    : _trace(trace), _name(name), _thread(thread), _iteration(iteration)
+{
+    if (_trace != nullptr) _begin = std::chrono::steady_clock::now();
+}
+
+opt::Trace::Span::~Span()
+{
+    if (_trace != nullptr) _trace->_add(_name, _thread, _iteration, _begin, std::chrono::steady_clock::now());
+}
+
+void opt::Trace::_add(const char *name, unsigned int thread, unsigned int iteration,
+    std::chrono::steady_clock::time_point begin, std::chrono::steady_clock::time_point end)
+{
+    Event event;
+    event.name = name;
+    event.thread = thread;
+    event.iteration = iteration;
+    event.begin = std::chrono::duration<double, std::micro>(begin - _start).count();
+    event.duration = std::chrono::duration<double, std::micro>(end - begin).count();
+    std::lock_guard<std::mutex> lock(_mutex);
+    _events.push_back(event);
+    _thread_number = std::max(_thread_number, thread + 1);
+}
+
+opt::Trace::Trace() : _start(std::chrono::steady_clock::now()), _thread_number(0)
+{}
+
+void opt::Trace::write(std::ostream &stream)
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    stream << std::fixed << std::setprecision(3);
+    stream << "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [" << std::endl;
+
+    //Name threads, thread 0 is the calling thread
+    for (unsigned int thread = 0; thread < _thread_number; thread++)
+    {
+        stream << "{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 0, \"tid\": " << thread << ", \"args\": {\"name\": \"";
+        if (thread == 0) stream << "main"; else stream << "worker " << (thread - 1);
+        stream << "\"}}," << std::endl;
+    }
+
+    //Write spans
+    for (auto event = _events.cbegin(); event != _events.cend(); event++)
+    {
+        stream << "{\"name\": \"" << event->name << "\", \"ph\": \"X\", \"pid\": 0, \"tid\": " << event->thread
+            << ", \"ts\": " << event->begin << ", \"dur\": " << event->duration;
+        if (event->iteration != no_iteration) stream << ", \"args\": {\"iteration\": " << event->iteration << "}";
+        stream << "}" << ((event + 1 != _events.cend()) ? "," : "") << std::endl;
+    }
+    stream << "]}" << std::endl;
+    stream.unsetf(std::ios_base::fixed);
+}
\ No newline at end of file
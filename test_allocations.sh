@@ -0,0 +1,55 @@
+#!/bin/sh
+#Checks that steady-state iterations of local search do not allocate, first iterations fill buffers and are skipped
+SCRIPT=$(readlink -f "$0")
+SCRIPT_PATH=$(dirname "${SCRIPT}")
+ALLOCATIONS_MAX=16
+mkdir -p ${SCRIPT_PATH}/build_stats
+cd ${SCRIPT_PATH}/build_stats
+
+cmake -DCMAKE_BUILD_TYPE=Release -DSTATS=1 ..
+if [ $? -ne 0 ]; then
+    echo "Configuration failed"
+    exit 1
+fi
+
+cmake --build .
+if [ $? -ne 0 ]; then
+    echo "Compilation failed"
+    exit 2
+fi
+
+FAILED=0
+check()
+{
+    #Arguments
+    NEIGHBORHOOD=$1
+    SKIP=$2
+    ITER_MAX=$3
+    SIZES=$4
+
+    # Execute, every iteration from SKIP on must stay under ALLOCATIONS_MAX
+    COMMAND="./optalg_cmd --method neighborhood --neighborhood ${NEIGHBORHOOD} ${SIZES} --stats true --threads 2 --iter_max ${ITER_MAX}"
+    echo "${COMMAND}"
+    ${COMMAND} | awk -v skip=${SKIP} -v max=${ALLOCATIONS_MAX} '
+        /^Iteration [0-9]+:/ {
+            iteration = $2 + 0
+            if (match($0, /[0-9]+ allocations/)) allocations = substr($0, RSTART, RLENGTH) + 0
+            if (iteration >= skip && allocations > max) { print "Iteration " iteration ": " allocations " allocations"; failed = 1 }
+            checked++
+        }
+        END { if (checked <= skip) { print "Too few iterations reported"; failed = 1 } exit failed }'
+    if [ $? -ne 0 ]; then
+        FAILED=1
+    fi
+}
+
+#Instances which do not reach the lower bound before the checked iterations
+check "order" 3 10 "--box_size 16 --item_number 200 --item_size_min 1 --item_size_max 9 --seed 3"
+check "order" 3 10 "--box_size 50 --item_number 500 --item_size_min 1 --item_size_max 25 --seed 1"
+check "geometry" 55 60 "--box_size 10 --item_number 100 --item_size_min 1 --item_size_max 5 --seed 0"
+
+if [ ${FAILED} -ne 0 ]; then
+    echo "Allocation check failed"
+    exit 3
+fi
+echo "Allocation check passed"